@@ -0,0 +1,306 @@
+//microbenchmarks of the proxy hot paths, one json object per line on stdout
+//usage: sawangbench [name filter], run by make bench
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+#include <uuid/uuid.h>
+#include <glib.h>
+
+#include "cJSON.h"
+#include "define.h"
+#include "log.h"
+#include "globaldata.h"
+#include "objectpool.h"
+#include "taskkey.h"
+#include "respondtable.h"
+#include "parsequeue.h"
+#include "replyqueue.h"
+#include "proxytask.h"
+#include "proxyuuid.h"
+#include "canonicaljson.h"
+
+#define BENCH_PAIRS_MAX 1000000//tasks * rids per respond table run
+#define BENCH_QUEUE_ITEMS 1000000
+#define BENCH_KEY_ITEMS 200000
+#define BENCH_UUID_ITEMS 1000000
+
+typedef struct BenchProducer {
+    unsigned int index;
+    unsigned long items;
+    TaskKey *key;
+} BenchProducer;
+
+static const unsigned long bench_tasks[] = { 1, 100, 10000, 100000 };
+static const unsigned long bench_rids[] = { 1, 100, 10000 };
+static const unsigned int bench_producers[] = { 1, 2, 4, 8 };
+
+//property
+static const char *bench_filter = NULL;
+
+//function
+static bool bench_selected(const char *name);
+static uint64_t bench_now(void);
+static void bench_report(const char *name, const char *params, unsigned long ops, uint64_t ns);
+static TaskKey *bench_task_key(unsigned long index);
+static void bench_respond_table(unsigned long tasks, unsigned long rids);
+static void *bench_parse_producer(void *arg);
+static void *bench_reply_producer(void *arg);
+static void bench_queue(const char *name, void *(*producer)(void*), bool parse, unsigned int producers);
+static void bench_task_key_print(bool canonical);
+static void bench_uuid(void);
+
+int main(int argc, char **argv) {
+    unsigned int t, r, p;
+
+    bench_filter = argc>1 ? argv[1] : NULL;
+    proxy_name = "sawangbench";
+    proxy_log_context_init(getpid(), "/tmp");
+    proxy_log_level_set("ERROR");
+    proxy_uuid_init();
+    object_pool_create();
+    task_key_table_create();
+    respond_table_create();
+    parse_queue_create();
+    reply_queue_create();
+
+    for(t=0; t<sizeof(bench_tasks) / sizeof(bench_tasks[0]); t++) {
+        for(r=0; r<sizeof(bench_rids) / sizeof(bench_rids[0]); r++) {
+            if(bench_tasks[t] * bench_rids[r]<=BENCH_PAIRS_MAX) {
+                bench_respond_table(bench_tasks[t], bench_rids[r]);
+            }
+        }
+    }
+    for(p=0; p<sizeof(bench_producers) / sizeof(bench_producers[0]); p++) {
+        bench_queue("parse_queue", bench_parse_producer, true, bench_producers[p]);
+    }
+    for(p=0; p<sizeof(bench_producers) / sizeof(bench_producers[0]); p++) {
+        bench_queue("reply_queue", bench_reply_producer, false, bench_producers[p]);
+    }
+    bench_task_key_print(false);
+    bench_task_key_print(true);
+    bench_uuid();
+
+    reply_queue_destroy();
+    parse_queue_destroy();
+    respond_table_destroy();
+    task_key_table_destroy();
+    object_pool_destroy();
+    proxy_uuid_destroy();
+    proxy_log_context_destroy();
+    return 0;
+}
+
+static bool bench_selected(const char *name) {
+    return bench_filter==NULL || strstr(name, bench_filter)!=NULL;
+}
+
+static uint64_t bench_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+//params is a json object body without braces
+static void bench_report(const char *name, const char *params, unsigned long ops, uint64_t ns) {
+    printf("{\"bench\":\"%s\",%s%s\"ops\":%lu,\"ns\":%llu,\"ns_per_op\":%.1f,\"ops_per_sec\":%.0f}\n",
+        name, params, strlen(params)>0 ? "," : "", ops, (unsigned long long)ns,
+        ops>0 ? (double)ns / ops : 0.0, ns>0 ? ops * 1e9 / ns : 0.0);
+    fflush(stdout);
+}
+
+//same layout as the unformatted service and payload of a channel request
+static TaskKey *bench_task_key(unsigned long index) {
+    char text[96];
+
+    snprintf(text, sizeof(text), "{\"service\":\"bench\",\"payload\":{\"key1\":\"value1\",\"id\":%lu}}", index);
+    return task_key_intern(text);
+}
+
+static void bench_respond_table(unsigned long tasks, unsigned long rids) {
+    TaskKey **keys;
+    char (*uuids)[UUIDBUFLEN];
+    char params[64];
+    RidSnapshot *snapshot;
+    TaskKey *key;
+    uint64_t start;
+    unsigned long i, pairs, samples;
+    uuid_t rid;
+
+    if(!bench_selected("respond_table")) {
+        return;
+    }
+    pairs = tasks * rids;
+    keys = (TaskKey**)malloc(tasks * sizeof(TaskKey*));
+    uuids = malloc(pairs * UUIDBUFLEN);
+    for(i=0; i<tasks; i++) {
+        keys[i] = bench_task_key(i);
+    }
+    for(i=0; i<pairs; i++) {
+        uuid_generate_random(rid);
+        uuid_unparse_lower(rid, uuids[i]);
+    }
+    snprintf(params, sizeof(params), "\"tasks\":%lu,\"rids\":%lu", tasks, rids);
+
+    //rid i subscribes task i / rids
+    start = bench_now();
+    for(i=0; i<pairs; i++) {
+        respond_table_set(RESPONDTABLE_MULTIRESPOND, keys[i / rids], uuids[i], NULL);
+    }
+    bench_report("respond_table_set", params, pairs, bench_now() - start);
+
+    start = bench_now();
+    for(i=0; i<tasks; i++) {
+        snapshot = respond_table_snapshot(RESPONDTABLE_MULTIRESPOND, keys[i]);
+        rid_snapshot_text(snapshot);//what a reply costs the first time after a change
+        rid_snapshot_unref(snapshot);
+    }
+    bench_report("respond_table_snapshot", params, tasks, bench_now() - start);
+
+    samples = pairs<BENCH_PAIRS_MAX / 10 ? pairs : BENCH_PAIRS_MAX / 10;
+    start = bench_now();
+    for(i=0; i<samples; i++) {
+        key = respond_table_dup_task_key(RESPONDTABLE_MULTIRESPOND, uuids[(i * 7919) % pairs]);
+        task_key_unref(key);
+    }
+    bench_report("respond_table_dup_task_key", params, samples, bench_now() - start);
+
+    start = bench_now();
+    for(i=0; i<pairs; i++) {
+        respond_table_drop(RESPONDTABLE_MULTIRESPOND, keys[i / rids], uuids[i], NULL);
+    }
+    bench_report("respond_table_drop", params, pairs, bench_now() - start);
+
+    for(i=0; i<tasks; i++) {
+        respond_table_remove(RESPONDTABLE_MULTIRESPOND, keys[i]);
+        task_key_unref(keys[i]);
+    }
+    free(uuids);
+    free(keys);
+}
+
+static void *bench_parse_producer(void *arg) {
+    BenchProducer *producer;
+    unsigned long i;
+
+    producer = (BenchProducer*)arg;
+    for(i=0; i<producer->items; i++) {
+        parse_queue_append(proxy_task_create("bench", NULL, task_key_ref(producer->key)), NULL, NULL, RESPONDTABLE_SINGLESHOT);
+    }
+    return NULL;
+}
+
+static void *bench_reply_producer(void *arg) {
+    BenchProducer *producer;
+    cJSON *headers;
+    char rid[UUIDBUFLEN + 2];
+    unsigned long i;
+
+    producer = (BenchProducer*)arg;
+    snprintf(rid, sizeof(rid), "\"%s\"", "00000000-0000-4000-8000-000000000000");
+    for(i=0; i<producer->items; i++) {
+        headers = cJSON_CreateObject();
+        cJSON_AddNumberToObject(headers, SERVICE_STATUS_KEY, producer->index);
+        reply_queue_append_rid_text(rid, headers, NULL, false, NULL);
+    }
+    return NULL;
+}
+
+//producers push concurrently while this thread pops, like the channel lanes and proxycomm or proxysubscribe
+static void bench_queue(const char *name, void *(*producer)(void*), bool parse, unsigned int producers) {
+    BenchProducer args[8];
+    pthread_t threads[8];
+    char params[32];
+    ParseQueueTask *parse_task;
+    ReplyQueueTask *reply_task;
+    TaskKey *key;
+    uint64_t start;
+    unsigned long popped, total;
+    unsigned int i;
+
+    if(!bench_selected(name)) {
+        return;
+    }
+    key = bench_task_key(0);
+    total = 0;
+    for(i=0; i<producers; i++) {
+        args[i].index = i;
+        args[i].items = BENCH_QUEUE_ITEMS / producers;
+        args[i].key = key;
+        total += args[i].items;
+    }
+
+    start = bench_now();
+    for(i=0; i<producers; i++) {
+        pthread_create(&threads[i], NULL, producer, &args[i]);
+    }
+    popped = 0;
+    while(popped<total) {
+        if(parse && (parse_task = parse_queue_pop_head())!=NULL) {
+            parse_queue_task_destroy(parse_task);
+            popped++;
+        } else if(!parse && (reply_task = reply_queue_pop_head())!=NULL) {
+            reply_queue_task_destroy(reply_task);
+            popped++;
+        } else {
+            sched_yield();
+        }
+    }
+    for(i=0; i<producers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    snprintf(params, sizeof(params), "\"producers\":%u", producers);
+    bench_report(name, params, total, bench_now() - start);
+    task_key_unref(key);
+}
+
+//the channel builds the task key by printing the normalized request and interning the text
+static void bench_task_key_print(bool canonical) {
+    cJSON *json, *payload;
+    TaskKey *key;
+    char *text;
+    uint64_t start;
+    unsigned long i;
+
+    if(!bench_selected("task_key")) {
+        return;
+    }
+    start = bench_now();
+    for(i=0; i<BENCH_KEY_ITEMS; i++) {
+        json = cJSON_CreateObject();
+        cJSON_AddStringToObject(json, SERVICE_SERVICE_KEY, "bench");
+        payload = cJSON_AddObjectToObject(json, SERVICE_PAYLOAD_KEY);
+        cJSON_AddNumberToObject(payload, "id", i % 1000);
+        cJSON_AddStringToObject(payload, "key2", "value2");
+        cJSON_AddStringToObject(payload, "key1", "value1");
+        if(canonical) {
+            canonical_json_sort(json);
+        }
+        text = cJSON_PrintUnformatted(json);
+        key = task_key_intern(text);
+        cJSON_free(text);
+        task_key_unref(key);
+        cJSON_Delete(json);
+    }
+    bench_report("task_key", canonical ? "\"canonical\":true" : "\"canonical\":false", BENCH_KEY_ITEMS, bench_now() - start);
+}
+
+static void bench_uuid(void) {
+    char buff[UUIDBUFLEN];
+    uint64_t start;
+    unsigned long i;
+
+    if(!bench_selected("proxy_uuid_generate")) {
+        return;
+    }
+    start = bench_now();
+    for(i=0; i<BENCH_UUID_ITEMS; i++) {
+        proxy_uuid_generate(buff);
+    }
+    bench_report("proxy_uuid_generate", "", BENCH_UUID_ITEMS, bench_now() - start);
+}
\ No newline at end of file
@@ -0,0 +1,158 @@
+//round trip latency and throughput of the segment handshake per wakeup backend, one json object per line on stdout
+//usage: sawangwakeup [round trips] [spin rounds], run by make bench
+//a forked proxy answers CHANNEL_REQUEST with CHANNEL_ACKNOWLEDGED over a shared segment laid out like the channel lane
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "proxy.h"
+#include "wakeup.h"
+
+#define BENCH_ROUND_TRIPS 200000
+#define BENCH_WARMUP 1000
+
+typedef struct BenchShm {
+    pthread_mutex_t lock;
+    pthread_cond_t dispatcher_wakeup;
+    pthread_cond_t proxy_wakeup;
+    enum ProxyChannelState state;
+    ProxyWakeupWord dispatcher_word;
+    ProxyWakeupWord proxy_word;
+} BenchShm;
+
+static const enum ProxyWakeupBackend bench_backends[] = { WAKEUP_CONDVAR, WAKEUP_FUTEX, WAKEUP_SPIN };
+
+//function
+static uint64_t bench_now(void);
+static int bench_compare(const void *a, const void *b);
+static bool bench_roundtrip(enum ProxyWakeupBackend backend, unsigned int spin, unsigned long round_trips, uint64_t *samples);
+static void bench_proxy(BenchShm *shm, Wakeup *dispatcher_wakeup, Wakeup *proxy_wakeup);
+
+int main(int argc, char **argv) {
+    uint64_t *samples;
+    unsigned long round_trips;
+    unsigned int i, spin;
+
+    round_trips = argc>1 ? strtoul(argv[1], NULL, 10) : BENCH_ROUND_TRIPS;
+    spin = argc>2 ? (unsigned int)atoi(argv[2]) : WAKEUP_SPIN_DEFAULT;
+    if(round_trips<1) {
+        fprintf(stderr, "usage: %s [round trips] [spin rounds]\n", argv[0]);
+        return 1;
+    }
+
+    samples = (uint64_t*)malloc(round_trips * sizeof(uint64_t));
+    for(i=0; i<sizeof(bench_backends) / sizeof(bench_backends[0]); i++) {
+        if(!bench_roundtrip(bench_backends[i], spin, round_trips, samples)) {
+            free(samples);
+            return 1;
+        }
+    }
+    free(samples);
+    return 0;
+}
+
+static uint64_t bench_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int bench_compare(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+
+    return x<y ? -1 : (x>y ? 1 : 0);
+}
+
+//this process plays gonggo, it holds the lock except while it waits like the dispatcher does
+static bool bench_roundtrip(enum ProxyWakeupBackend backend, unsigned int spin, unsigned long round_trips, uint64_t *samples) {
+    BenchShm *shm;
+    Wakeup dispatcher_wakeup, proxy_wakeup;
+    pthread_mutexattr_t mutexattr;
+    uint64_t start, total, sum;
+    unsigned long i;
+    pid_t pid;
+
+    shm = (BenchShm*)mmap(NULL, sizeof(BenchShm), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(shm==MAP_FAILED) {
+        fprintf(stderr, "cannot map the bench segment: %s\n", strerror(errno));
+        return false;
+    }
+    pthread_mutexattr_init(&mutexattr);
+    pthread_mutexattr_setpshared(&mutexattr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&mutexattr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&shm->lock, &mutexattr);
+    pthread_mutexattr_destroy(&mutexattr);
+    wakeup_bind(&dispatcher_wakeup, backend, spin, &shm->lock, &shm->dispatcher_wakeup, &shm->dispatcher_word);
+    wakeup_bind(&proxy_wakeup, backend, spin, &shm->lock, &shm->proxy_wakeup, &shm->proxy_word);
+    wakeup_init(&dispatcher_wakeup);
+    wakeup_init(&proxy_wakeup);
+    shm->state = CHANNEL_IDLE;
+
+    pid = fork();
+    if(pid==-1) {
+        fprintf(stderr, "cannot fork the bench proxy: %s\n", strerror(errno));
+        munmap(shm, sizeof(BenchShm));
+        return false;
+    } else if(pid==0) {
+        bench_proxy(shm, &dispatcher_wakeup, &proxy_wakeup);
+        _exit(0);
+    }
+
+    pthread_mutex_lock(&shm->lock);
+    total = 0;
+    for(i=0; i<BENCH_WARMUP + round_trips; i++) {
+        if(i==BENCH_WARMUP) {
+            total = bench_now();
+        }
+        start = bench_now();
+        shm->state = CHANNEL_REQUEST;
+        wakeup_signal(&proxy_wakeup);
+        while(shm->state==CHANNEL_REQUEST) {
+            wakeup_wait(&dispatcher_wakeup);
+        }
+        if(i>=BENCH_WARMUP) {
+            samples[i - BENCH_WARMUP] = bench_now() - start;
+        }
+    }
+    total = bench_now() - total;
+    shm->state = CHANNEL_TERMINATION;
+    wakeup_signal(&proxy_wakeup);
+    pthread_mutex_unlock(&shm->lock);
+    waitpid(pid, NULL, 0);
+    munmap(shm, sizeof(BenchShm));
+
+    sum = 0;
+    for(i=0; i<round_trips; i++) {
+        sum += samples[i];
+    }
+    qsort(samples, round_trips, sizeof(uint64_t), bench_compare);
+    printf("{\"bench\":\"wakeup_roundtrip\",\"backend\":\"%s\",\"spin\":%u,\"ops\":%lu,\"ns\":%llu,\"ns_per_op\":%.1f,"
+        "\"p50_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu,\"max_ns\":%llu,\"ops_per_sec\":%.0f}\n",
+        wakeup_backend_name(backend), backend==WAKEUP_SPIN ? dispatcher_wakeup.spin : 0, round_trips, (unsigned long long)total, (double)sum / round_trips,
+        (unsigned long long)samples[round_trips / 2], (unsigned long long)samples[round_trips * 99 / 100],
+        (unsigned long long)samples[round_trips * 999 / 1000], (unsigned long long)samples[round_trips - 1],
+        total>0 ? round_trips * 1e9 / total : 0.0);
+    fflush(stdout);
+    return true;
+}
+
+//the proxy side of proxy_channel, lock held except while waiting
+static void bench_proxy(BenchShm *shm, Wakeup *dispatcher_wakeup, Wakeup *proxy_wakeup) {
+    pthread_mutex_lock(&shm->lock);
+    while(shm->state!=CHANNEL_TERMINATION) {
+        if(shm->state==CHANNEL_REQUEST) {
+            shm->state = CHANNEL_ACKNOWLEDGED;
+            wakeup_signal(dispatcher_wakeup);
+        }
+        wakeup_wait(proxy_wakeup);
+    }
+    pthread_mutex_unlock(&shm->lock);
+}
\ No newline at end of file
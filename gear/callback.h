@@ -34,11 +34,16 @@ typedef void (*ProxyFree) (ProxyReplyArg *arg);
 
 /*
  * To be implemented by customized proxy as required by work(...) defined in work.h
- * 1. ProxyPayloadParse: runs in proxychannel thread on client request parsing.
+ * 1. ProxyPayloadParse: runs in proxychannel thread on client request parsing, or in parseworker threads when parse_workers is set,
+ *    it runs concurrently and must be thread safe when channel_lanes is more than 1 or parse_workers is more than 0.
  * 2. ProxyStart: runs in proxy proxycomm thread start. A function to initialize resources.
  * 3. ProxyRun: runs in proxycomm loop.
  * 4. ProxyMultiRespondClear: runs in proxycomm loop to clear a multirespond service.
  * 5. ProxyStop: run in proxycomm thread stop. A function to destroy resources.
+ * 6. ProxyRest: optional, runs in proxychannel thread on CHANNEL_REST, each REST lane thread when rest_lanes is set,
+ *    it must be thread safe when more than one lane serves REST.
+ * f_proxy_reply is fastest with the ProxyReplyArg pointer handed to ProxyRun, an arg the proxy built or copied
+ * is still answered by rebuilding its task key from service and payload.
  */
 typedef enum ProxyPayloadParseResult (*ProxyPayloadParse) (
     const char *service_name, 
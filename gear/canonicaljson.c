@@ -0,0 +1,74 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "canonicaljson.h"
+
+#define CANONICALJSON_STACK_MEMBERS 32
+
+typedef struct CanonicalJsonMember {
+    cJSON *item;
+    size_t order;//keeps duplicate keys in their original order
+} CanonicalJsonMember;
+
+//function
+static void canonical_json_sort_members(cJSON *object);
+static int canonical_json_member_compare(const void *m1, const void *m2);
+
+void canonical_json_sort(cJSON *json) {
+    cJSON *child;
+
+    if(json==NULL) {
+        return;
+    }
+    if(cJSON_IsObject(json)) {
+        canonical_json_sort_members(json);
+    }
+    if(cJSON_IsObject(json) || cJSON_IsArray(json)) {
+        for(child=json->child; child!=NULL; child=child->next) {
+            canonical_json_sort(child);
+        }
+    }
+}
+
+static void canonical_json_sort_members(cJSON *object) {
+    CanonicalJsonMember stack_members[CANONICALJSON_STACK_MEMBERS], *members;
+    cJSON *child;
+    size_t count, i;
+
+    count = 0;
+    for(child=object->child; child!=NULL; child=child->next) {
+        count++;
+    }
+    if(count<2) {
+        return;
+    }
+
+    members = count<=CANONICALJSON_STACK_MEMBERS ? stack_members : (CanonicalJsonMember*)malloc(count * sizeof(CanonicalJsonMember));
+    for(child=object->child, i=0; child!=NULL; child=child->next, i++) {
+        members[i].item = child;
+        members[i].order = i;
+    }
+    qsort(members, count, sizeof(CanonicalJsonMember), canonical_json_member_compare);
+
+    //relink, cJSON keeps child->prev pointing to the last member
+    for(i=0; i<count; i++) {
+        members[i].item->prev = i>0 ? members[i-1].item : members[count-1].item;
+        members[i].item->next = i+1<count ? members[i+1].item : NULL;
+    }
+    object->child = members[0].item;
+
+    if(members!=stack_members) {
+        free(members);
+    }
+}
+
+static int canonical_json_member_compare(const void *m1, const void *m2) {
+    const CanonicalJsonMember *a = (const CanonicalJsonMember*)m1, *b = (const CanonicalJsonMember*)m2;
+    int cmp;
+
+    cmp = strcmp(a->item->string!=NULL ? a->item->string : "", b->item->string!=NULL ? b->item->string : "");
+    if(cmp!=0) {
+        return cmp;
+    }
+    return a->order<b->order ? -1 : (a->order>b->order ? 1 : 0);
+}
\ No newline at end of file
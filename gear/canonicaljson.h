@@ -0,0 +1,13 @@
+#ifndef _CANONICALJSON_H_
+#define _CANONICALJSON_H_
+
+#include "cJSON.h"
+
+/*
+ * Sort object members by key at every level, in place. Arrays keep their order.
+ * cJSON_PrintUnformatted of a sorted tree is canonical: no whitespace and numbers printed from their double value,
+ * so {"b":2,"a":1.0} and {"a":1,"b":2} print the same text.
+ */
+extern void canonical_json_sort(cJSON *json);
+
+#endif //_CANONICALJSON_H_
\ No newline at end of file
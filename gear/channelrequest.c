@@ -0,0 +1,271 @@
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "log.h"
+#include "define.h"
+#include "respondtable.h"
+#include "replyqueue.h"
+#include "parsequeue.h"
+#include "proxytask.h"
+#include "canonicaljson.h"
+#include "jsonarena.h"
+#include "metrics.h"
+#include "trace.h"
+#include "probe.h"
+#include "proxyservicestatus.h"
+#include "channelrequest.h"
+
+//property
+static ProxyPayloadParse channel_request_payload_parse = NULL;
+static GHashTable *channel_request_canonical_services = NULL;//set of service names
+static bool channel_request_canonical_all = false;
+
+//function
+static cJSON *channel_request_take_payload(ChannelRequest *request, cJSON *service_and_payload);
+static ProxyTask *channel_request_create_task(ChannelRequest *request, cJSON *service_and_payload, TaskKey *task_key);
+static TaskKey *channel_request_create_unsubscribe_task_key(const char *service_name, const cJSON *payload, enum ProxyServiceStatus *status, const char**rid);
+static TaskKey *channel_request_task_key(const cJSON *service_and_payload);
+static bool channel_request_canonical(const char *service_name);
+
+void channel_request_context_init(const ConfVar *cv_head, ProxyPayloadParse f_payload_parse) {
+    const char *value;
+    char *list, *token, *saveptr, *end;
+
+    channel_request_payload_parse = f_payload_parse;
+
+    channel_request_canonical_services = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)free, NULL);
+    channel_request_canonical_all = false;
+    if((value = confvar_value(cv_head, CONF_CANONICAL_SERVICES))!=NULL) {
+        list = strdup(value);
+        for(token=strtok_r(list, ",", &saveptr); token!=NULL; token=strtok_r(NULL, ",", &saveptr)) {
+            while(*token==' ' || *token=='\t') {
+                token++;
+            }
+            end = token + strlen(token);
+            while(end>token && (end[-1]==' ' || end[-1]=='\t')) {
+                *--end = 0;
+            }
+            if(strcmp(token, "*")==0) {
+                channel_request_canonical_all = true;
+            } else if(strlen(token)>0) {
+                g_hash_table_insert(channel_request_canonical_services, strdup(token), NULL);
+            }
+        }
+        free(list);
+    }
+}
+
+void channel_request_context_destroy(void) {
+    if(channel_request_canonical_services!=NULL) {
+        g_hash_table_destroy(channel_request_canonical_services);
+        channel_request_canonical_services = NULL;
+    }
+}
+
+//take over service_and_payload, return false when it is NULL, request->trace is left as the caller set it
+bool channel_request_parse(cJSON *service_and_payload, ChannelRequest *request) {
+    cJSON *service;
+    uint64_t start;
+    TraceContext parse_trace;
+
+    request->normalized_payload = NULL;
+    request->invalid_status = 0;
+    request->payload = NULL;
+    request->service_name = "";
+    request->parse_result = PARSE_INVALID;
+    request->unsubscribe = false;
+
+    request->service_and_payload = service_and_payload;
+    if(request->service_and_payload==NULL) {
+        metrics_add(METRICS_REQUEST_UNREADABLE, 1);
+        return false;
+    }
+
+    service = cJSON_GetObjectItem(request->service_and_payload, SERVICE_SERVICE_KEY);
+    request->payload = cJSON_GetObjectItem(request->service_and_payload, SERVICE_PAYLOAD_KEY);//optional
+    request->service_name = service!=NULL ? cJSON_GetStringValue(service) : "";
+    if(strcmp(request->service_name, GONGGOSERVICE_REQUEST_DROP)==0) {
+        request->parse_result = PARSE_SINGLESHOT;
+        request->normalized_payload = request->payload;
+        request->unsubscribe = true;
+    } else {
+        start = metrics_now();
+        parse_trace = request->trace;//nested in the channel read span
+        trace_mark(&parse_trace);
+        request->parse_result = channel_request_payload_parse(request->service_name, request->payload, 
+            &request->normalized_payload, &request->unsubscribe, &request->invalid_status);
+        metrics_observe(METRICS_PAYLOAD_PARSE, start);
+        trace_span(&parse_trace, TRACE_PAYLOAD_PARSE);
+    }
+    return true;
+}
+
+void channel_request_dispatch(const char *rid, ChannelRequest *request, bool *comm_awake, bool *subscribe_awake) {
+    cJSON *norm_service_and_payload;
+    bool new_job, new_task;
+    TaskKey *task_key, *unsubscribe_task_key;
+    const char *request_uuid;
+    enum RespondTableType respond_table_type;
+    enum ProxyServiceStatus proxy_service_status;
+    uuid_t bin_rid;
+
+    SAWANG_PROBE(channel__dispatch, rid, request->service_name, request->parse_result);
+    if(request->parse_result==PARSE_INVALID) {
+        metrics_add(METRICS_REQUEST_INVALID, 1);
+        reply_queue_append_invalid_status(rid, request->invalid_status);
+        *subscribe_awake = true;
+        return;
+    }
+    //the respond table keeps binary rids, a rid it cannot hold would leave the client without answer
+    if(!rid_parse(rid, bin_rid)) {
+        proxy_log("ERROR", "service %s request id %s is not a lowercase uuid", request->service_name, rid!=NULL ? rid : "");
+        metrics_add(METRICS_REQUEST_INVALID, 1);
+        reply_queue_append_invalid_status(rid, PROXYSERVICESTATUS_PAYLOAD_INVALID);
+        *subscribe_awake = true;
+        return;
+    }
+
+    if(request->unsubscribe) {
+        proxy_service_status = PROXYSERVICESTATUS_MULTIRESPOND_CLEAR_SUCCESS;
+        unsubscribe_task_key = channel_request_create_unsubscribe_task_key(request->service_name, request->payload, &proxy_service_status, &request_uuid);
+        if(unsubscribe_task_key==NULL) {
+            metrics_add(METRICS_REQUEST_INVALID, 1);
+            reply_queue_append_invalid_status(rid, proxy_service_status);
+            *subscribe_awake = true;
+        } else {
+            metrics_add(METRICS_REQUEST_UNSUBSCRIBE, 1);
+            task_key = channel_request_task_key(request->service_and_payload);
+            respond_table_set(RESPONDTABLE_SINGLESHOT, task_key, rid, NULL);
+            //request_uuid lives in the payload, parse_queue_append copies it before the task owns the payload
+            parse_queue_append(
+                channel_request_create_task(request, request->service_and_payload, task_key), 
+                unsubscribe_task_key, request_uuid, RESPONDTABLE_SINGLESHOT);
+            *comm_awake = true;
+            task_key_unref(unsubscribe_task_key);
+        }
+        return;
+    }
+
+    if(request->payload==NULL || request->payload==request->normalized_payload) {
+        norm_service_and_payload = request->service_and_payload;
+    } else {
+        norm_service_and_payload = cJSON_CreateObject();
+        cJSON_AddItemToObject(norm_service_and_payload, SERVICE_SERVICE_KEY, cJSON_CreateString(request->service_name));
+        if(request->normalized_payload!=NULL) {        
+            cJSON_AddItemToObject(norm_service_and_payload, SERVICE_PAYLOAD_KEY, request->normalized_payload);
+            request->normalized_payload = NULL;//owned by norm_service_and_payload
+        }                    
+    }
+    if(channel_request_canonical(request->service_name)) {
+        canonical_json_sort(norm_service_and_payload);//equal payloads share one task key whatever the member order
+    }
+    task_key = channel_request_task_key(norm_service_and_payload);
+    new_job = true;
+    respond_table_type = request->parse_result==PARSE_MULTIRESPOND ? RESPONDTABLE_MULTIRESPOND : RESPONDTABLE_SINGLESHOT;                    
+    if(respond_table_type==RESPONDTABLE_MULTIRESPOND) {
+        new_job = respond_table_set(RESPONDTABLE_MULTIRESPOND, task_key, rid, &new_task);
+        metrics_add(new_task ? METRICS_REQUEST_MULTIRESPOND : METRICS_REQUEST_MULTIRESPOND_JOINED, 1);
+    } else {
+        respond_table_set(RESPONDTABLE_SINGLESHOT, task_key, rid, NULL);
+        metrics_add(METRICS_REQUEST_SINGLESHOT, 1);
+    }
+    if(new_job) {
+        parse_queue_append(
+            channel_request_create_task(request, norm_service_and_payload, task_key), 
+            NULL, NULL, respond_table_type);
+        *comm_awake = true;
+    } else {
+        task_key_unref(task_key);
+    }
+    if(norm_service_and_payload!=request->service_and_payload) {
+        cJSON_Delete(norm_service_and_payload);
+    }
+}
+
+void channel_request_clear(ChannelRequest *request) {
+    if(request->normalized_payload!=NULL && (request->payload==NULL || request->normalized_payload!=request->payload)) {
+        cJSON_Delete(request->normalized_payload);
+    }
+    if(request->service_and_payload!=NULL) {
+        cJSON_Delete(request->service_and_payload);
+    }
+    request->normalized_payload = NULL;
+    request->service_and_payload = NULL;
+    request->payload = NULL;
+}
+
+//detach the payload for a task, request no longer refers to it
+static cJSON *channel_request_take_payload(ChannelRequest *request, cJSON *service_and_payload) {
+    cJSON *payload;
+
+    payload = cJSON_DetachItemFromObject(service_and_payload, SERVICE_PAYLOAD_KEY);
+    if(service_and_payload==request->service_and_payload) {
+        if(request->normalized_payload==request->payload) {
+            request->normalized_payload = NULL;
+        }
+        request->payload = NULL;
+    }
+
+    return payload;
+}
+
+//take over the task_key reference, the task carries the request trace on
+static ProxyTask *channel_request_create_task(ChannelRequest *request, cJSON *service_and_payload, TaskKey *task_key) {
+    ProxyTask *task;
+
+    task = proxy_task_create(request->service_name, channel_request_take_payload(request, service_and_payload), task_key);
+    task->trace = request->trace;
+
+    return task;
+}
+
+static TaskKey *channel_request_create_unsubscribe_task_key(const char *service_name, const cJSON *payload, enum ProxyServiceStatus *status, const char**rid)
+{
+    cJSON *item;
+    TaskKey *unsubscribe_task_key;
+
+    *rid = NULL;
+
+    if(payload==NULL) {
+        proxy_log("ERROR", "multirespond unsubscribe service %s does not have payload", service_name);
+        *status = PROXYSERVICESTATUS_MULTIRESPOND_CLEAR_PAYLOAD_MISSING;
+        return NULL;
+    }
+
+    item = payload!=NULL ? cJSON_GetObjectItem(payload, SERVICE_RID_KEY) : NULL;
+    *rid = (const char*)(item!=NULL ? cJSON_GetStringValue(item) : NULL);
+    if(*rid==NULL || strlen(*rid)<1) {
+        proxy_log("ERROR", "multirespond unsubscribe service %s payload does not have rid under key %s", service_name, SERVICE_RID_KEY);
+        *status = PROXYSERVICESTATUS_MULTIRESPOND_CLEAR_PAYLOAD_RID_MISSING;
+        return NULL;
+    }
+
+    unsubscribe_task_key = respond_table_dup_task_key(RESPONDTABLE_MULTIRESPOND, *rid);
+    if(unsubscribe_task_key==NULL) {
+        proxy_log("ERROR", "multirespond unsubscribe service %s rid does not exists", service_name);
+        *status = PROXYSERVICESTATUS_MULTIRESPOND_CLEAR_PAYLOAD_RID_INVALID;
+        return NULL;        
+    }
+
+    *status = PROXYSERVICESTATUS_MULTIRESPOND_CLEAR_SUCCESS;
+    return unsubscribe_task_key;
+}
+
+static TaskKey *channel_request_task_key(const cJSON *service_and_payload) {
+    char *text;
+    TaskKey *task_key;
+
+    json_arena_begin();
+    text = cJSON_PrintUnformatted(service_and_payload);
+    task_key = task_key_intern(text);
+    cJSON_free(text);
+    json_arena_end();
+
+    return task_key;
+}
+
+static bool channel_request_canonical(const char *service_name) {
+    return channel_request_canonical_all 
+        || (channel_request_canonical_services!=NULL && g_hash_table_contains(channel_request_canonical_services, service_name));
+}
\ No newline at end of file
@@ -0,0 +1,28 @@
+#ifndef _CHANNELREQUEST_H_
+#define _CHANNELREQUEST_H_
+
+#include <stdbool.h>
+
+#include "cJSON.h"
+#include "callback.h"
+#include "confvar.h"
+#include "trace.h"
+
+typedef struct ChannelRequest {
+    cJSON *service_and_payload;
+    cJSON *payload;
+    cJSON *normalized_payload;
+    const char *service_name;
+    enum ProxyPayloadParseResult parse_result;
+    bool unsubscribe;
+    unsigned int invalid_status;
+    TraceContext trace;//set by the caller before channel_request_parse
+} ChannelRequest;
+
+extern void channel_request_context_init(const ConfVar *cv_head, ProxyPayloadParse f_payload_parse);
+extern void channel_request_context_destroy(void);
+extern bool channel_request_parse(cJSON *service_and_payload, ChannelRequest *request);
+extern void channel_request_dispatch(const char *rid, ChannelRequest *request, bool *comm_awake, bool *subscribe_awake);
+extern void channel_request_clear(ChannelRequest *request);
+
+#endif //_CHANNELREQUEST_H_
\ No newline at end of file
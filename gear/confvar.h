@@ -9,6 +9,25 @@
 #define CONF_SAWANG "sawang"
 #define CONF_GONGGO "gonggo"
 
+//optional
+#define CONF_CHANNEL_LANES "channel_lanes" //number of channel shm and thread pairs, default 1
+#define CONF_REST_LANES "rest_lanes" //number of REST shm and thread pairs, 0 serves REST on the channel lanes
+#define CONF_PARSE_WORKERS "parse_workers" //number of payload parsing threads, 0 parses on the channel thread
+#define CONF_CANONICAL_SERVICES "canonical_services" //comma separated services whose task key is built from sorted payload members, * for all
+#define CONF_CHANNEL_RING "channel_ring" //channel payload and REST answer ring capacity in bytes, 0 disables the ring
+#define CONF_SUBSCRIBE_RING "subscribe_ring" //subscribe answer ring capacity in bytes, 0 disables the ring
+#define CONF_SUBSCRIBE_BATCH "subscribe_batch" //maximum answers per subscribe handshake, default 1
+#define CONF_SUBSCRIBE_BATCH_BYTES "subscribe_batch_bytes" //stop collecting a batch once it reaches the bytes, 0 is unlimited
+#define CONF_JSON_ARENA "json_arena" //per thread arena bytes for short lived cJSON allocations, 0 disables the arena
+#define CONF_LOG_LEVEL "log_level" //DEBUG, INFO, WARNING or ERROR, default INFO
+#define CONF_LOG_ASYNC "log_async" //0 writes each line from the logging thread, default 1 hands lines to a writer thread
+#define CONF_METRICS "metrics" //0 disables the /<proxy>_metrics segment, default 1
+#define CONF_TRACE_SAMPLE "trace_sample" //trace one request in every n, 0 disables tracing
+#define CONF_TRACE_PATH "trace_path" //trace dump file, default <logpath>/<proxy>-trace.json
+#define CONF_TRACE_FORMAT "trace_format" //jsonl for one span per line, chrome for the trace event format, default jsonl
+#define CONF_WAKEUP "wakeup" //condvar, futex or spin handshake wakeup of the channel and subscribe segments, default condvar
+#define CONF_WAKEUP_SPIN "wakeup_spin" //rounds the spin wakeup polls before sleeping, default 1000
+
 typedef struct ConfVar
 {
 	char *name;
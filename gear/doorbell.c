@@ -0,0 +1,38 @@
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <limits.h>
+
+#include "doorbell.h"
+
+//function
+static void doorbell_futex(_Atomic uint32_t *addr, int op, uint32_t val);
+
+void doorbell_init(Doorbell *bell) {
+    atomic_init(&bell->sequence, 0);
+    atomic_init(&bell->parked, 0);
+}
+
+void doorbell_ring(Doorbell *bell) {
+    atomic_fetch_add(&bell->sequence, 1);
+    if(atomic_load(&bell->parked)) {
+        doorbell_futex(&bell->sequence, FUTEX_WAKE_PRIVATE, INT_MAX);
+    }
+}
+
+uint32_t doorbell_sequence(Doorbell *bell) {
+    return atomic_load(&bell->sequence);
+}
+
+//parked is published before sequence is checked again, a ringer either sees it or has already moved sequence
+void doorbell_wait(Doorbell *bell, uint32_t sequence) {
+    atomic_store(&bell->parked, 1);
+    while(atomic_load(&bell->sequence)==sequence) {
+        doorbell_futex(&bell->sequence, FUTEX_WAIT_PRIVATE, sequence);//EAGAIN and EINTR fall back to the check
+    }
+    atomic_store(&bell->parked, 0);
+}
+
+static void doorbell_futex(_Atomic uint32_t *addr, int op, uint32_t val) {
+    syscall(SYS_futex, (uint32_t*)addr, op, val, NULL, NULL, 0);
+}
\ No newline at end of file
@@ -0,0 +1,19 @@
+#ifndef _DOORBELL_H_
+#define _DOORBELL_H_
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+//wakeup for one consumer thread, every source it waits for (queues, stop request) rings the same doorbell
+//a ring costs one atomic add, the futex wake is issued only when the consumer is parked
+typedef struct Doorbell {
+    _Atomic uint32_t sequence;
+    _Atomic uint32_t parked;
+} Doorbell;
+
+extern void doorbell_init(Doorbell *bell);
+extern void doorbell_ring(Doorbell *bell);//any thread
+extern uint32_t doorbell_sequence(Doorbell *bell);//consumer, read before draining its sources
+extern void doorbell_wait(Doorbell *bell, uint32_t sequence);//consumer, return at once when rung since sequence
+
+#endif //_DOORBELL_H_
\ No newline at end of file
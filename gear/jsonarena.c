@@ -0,0 +1,114 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "cJSON.h"
+#include "jsonarena.h"
+#include "log.h"
+
+#define JSONARENA_ALIGN 16
+#define JSONARENA_MIN 4096
+
+typedef struct JsonArena {
+    char *base;
+    size_t used;
+    unsigned int depth;
+} JsonArena;
+
+//property
+static volatile bool json_arena_enabled = false;
+static unsigned int json_arena_capacity = 0;
+static pthread_key_t json_arena_key;//free a thread arena on thread exit
+static __thread JsonArena json_arena_local;
+
+//function
+static void *json_arena_malloc(size_t size);
+static void json_arena_free(void *p);
+static bool json_arena_owns(const JsonArena *arena, const void *p);
+static void json_arena_thread_exit(void *base);
+
+void json_arena_init(const ConfVar *cv_head) {
+    cJSON_Hooks hooks;
+
+    if(json_arena_enabled) {
+        return;
+    }
+    if(!confvar_uint(cv_head, CONF_JSON_ARENA, &json_arena_capacity) || json_arena_capacity<1) {
+        json_arena_capacity = 0;
+        return;
+    }
+    if(json_arena_capacity<JSONARENA_MIN) {
+        json_arena_capacity = JSONARENA_MIN;
+    }
+    pthread_key_create(&json_arena_key, json_arena_thread_exit);
+
+    hooks.malloc_fn = json_arena_malloc;
+    hooks.free_fn = json_arena_free;
+    cJSON_InitHooks(&hooks);
+    json_arena_enabled = true;
+    proxy_log("INFO", "cJSON per thread arena of %u bytes", json_arena_capacity);
+}
+
+//every thread is joined, the caller arena is released here
+void json_arena_destroy(void) {
+    if(json_arena_enabled) {
+        cJSON_InitHooks(NULL);
+        json_arena_enabled = false;
+        free(json_arena_local.base);
+        json_arena_local.base = NULL;
+        pthread_key_delete(json_arena_key);
+    }
+}
+
+void json_arena_begin(void) {
+    if(!json_arena_enabled) {
+        return;
+    }
+    if(json_arena_local.base==NULL) {
+        json_arena_local.base = (char*)malloc(json_arena_capacity);
+        json_arena_local.used = 0;
+        json_arena_local.depth = 0;
+        pthread_setspecific(json_arena_key, json_arena_local.base);
+    }
+    json_arena_local.depth++;
+}
+
+void json_arena_end(void) {
+    if(json_arena_enabled && json_arena_local.depth>0 && --json_arena_local.depth==0) {
+        json_arena_local.used = 0;
+    }
+}
+
+//a request beyond the arena capacity falls back to malloc, json_arena_free tells them apart by address
+static void *json_arena_malloc(size_t size) {
+    JsonArena *arena;
+    size_t aligned;
+    void *p;
+
+    arena = &json_arena_local;
+    if(arena->depth>0) {
+        aligned = (size + JSONARENA_ALIGN - 1) & ~((size_t)JSONARENA_ALIGN - 1);
+        if(aligned<=json_arena_capacity - arena->used) {
+            p = arena->base + arena->used;
+            arena->used += aligned;
+            return p;
+        }
+    }
+    return malloc(size);
+}
+
+static void json_arena_free(void *p) {
+    if(!json_arena_owns(&json_arena_local, p)) {
+        free(p);
+    }
+}
+
+static bool json_arena_owns(const JsonArena *arena, const void *p) {
+    return arena->base!=NULL && (uintptr_t)p>=(uintptr_t)arena->base && (uintptr_t)p<(uintptr_t)arena->base + json_arena_capacity;
+}
+
+static void json_arena_thread_exit(void *base) {
+    free(base);
+    json_arena_local.base = NULL;
+}
\ No newline at end of file
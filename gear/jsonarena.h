@@ -0,0 +1,16 @@
+#ifndef _JSONARENA_H_
+#define _JSONARENA_H_
+
+#include "confvar.h"
+
+//cJSON allocation hooks backed by a per thread bump arena
+//between json_arena_begin and json_arena_end every cJSON allocation of the thread comes from its arena,
+//free is a no-op there and json_arena_end of the outermost scope resets the arena,
+//so nothing allocated inside a scope may outlive it, release printed text with cJSON_free
+//outside a scope the hooks are plain malloc and free
+extern void json_arena_init(const ConfVar *cv_head);
+extern void json_arena_destroy(void);
+extern void json_arena_begin(void);
+extern void json_arena_end(void);
+
+#endif //_JSONARENA_H_
\ No newline at end of file
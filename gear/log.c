@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <string.h>
@@ -8,10 +9,13 @@
 #include <stdlib.h>
 #include <pthread.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
 
 #include "define.h"
 #include "log.h"
 #include "globaldata.h"
+#include "doorbell.h"
 
 #ifdef HAVE_ST_BIRTHTIME
 #define birthtime(x) x.st_birthtime
@@ -19,10 +23,70 @@
 #define birthtime(x) x.st_ctime
 #endif
 
+#define PROXYLOG_RING_RECORDS 128//per logging thread, power of 2
+#define PROXYLOG_RECORD_TEXT 448//longer lines are copied to the heap
+#define PROXYLOG_LEVEL_LEN 16
+#define PROXYLOG_WRITE_LINES 64//lines per writev, three iovec each
+
+enum ProxyLogRank {
+    PROXYLOG_DEBUG = 0,
+    PROXYLOG_INFO,
+    PROXYLOG_WARNING,
+    PROXYLOG_ERROR
+};
+
+typedef struct ProxyLogRecord {
+    time_t t;
+    char level[PROXYLOG_LEVEL_LEN];
+    char *long_text;//heap copy when the line does not fit text
+    size_t length;
+    char text[PROXYLOG_RECORD_TEXT];
+} ProxyLogRecord;
+
+//single producer single consumer, a ring belongs to one thread at a time and is reused after that thread exits
+typedef struct ProxyLogRing {
+    _Atomic unsigned int head;//next record to fill, producer side
+    _Atomic unsigned int tail;//next record to write, writer side
+    atomic_bool in_use;
+    struct ProxyLogRing *next;//registry, rings are never unlinked before proxy_log_context_destroy
+    ProxyLogRecord records[PROXYLOG_RING_RECORDS];
+} ProxyLogRing;
+
 static pid_t proxy_log_pid;
 static const char *proxy_log_path;
 static bool has_proxy_log_lock = false;
 static pthread_mutex_t proxy_log_lock;
+static volatile int proxy_log_min_rank = PROXYLOG_INFO;
+
+////async writer
+static volatile bool proxy_log_async = false;
+static volatile bool proxy_log_writer_end = false;
+static pthread_t proxy_log_writer_thread;
+static Doorbell proxy_log_doorbell;
+static _Atomic(ProxyLogRing*) proxy_log_rings = NULL;
+static atomic_uint proxy_log_dropped = 0;
+static pthread_key_t proxy_log_ring_key;//release the thread ring on thread exit
+static __thread ProxyLogRing *proxy_log_local_ring = NULL;
+static atomic_uint proxy_log_generation = 0;//bumped when the rings are freed
+static __thread unsigned int proxy_log_local_generation = 0;
+static int proxy_log_fd = -1;//writer thread only
+static int proxy_log_fd_yday = -1;
+static int proxy_log_fd_year = -1;
+
+//function
+static int proxy_log_rank(const char *level);
+static void proxy_log_direct(const char *level, const char *fmt, va_list args);
+static int proxy_log_open(const struct tm *tm_now);
+static void proxy_log_enqueue(const char *level, const char *fmt, va_list args);
+static ProxyLogRing *proxy_log_thread_ring(void);
+static void proxy_log_ring_release(void *ring);
+static void *proxy_log_writer(void *arg);
+static void proxy_log_drain(void);
+static unsigned int proxy_log_drain_ring(ProxyLogRing *ring);
+static void proxy_log_writev(struct iovec *iov, int iovcnt);
+static bool proxy_log_switch(time_t t);
+static bool proxy_log_day_open(time_t t);
+static void proxy_log_report_dropped(void);
 
 void proxy_log_context_init(pid_t pid, const char *path) {
     if(!has_proxy_log_lock) {
@@ -37,7 +101,47 @@ void proxy_log_context_init(pid_t pid, const char *path) {
     proxy_log_path = path;
 }
 
+void proxy_log_configure(const ConfVar *cv_head) {
+    const char *level;
+    unsigned int async;
+
+    if( (level = confvar_value(cv_head, CONF_LOG_LEVEL))!=NULL ) {
+        proxy_log_level_set(level);
+    }
+    if(!confvar_uint(cv_head, CONF_LOG_ASYNC, &async)) {
+        async = 1;
+    }
+    if(async<1 || proxy_log_async) {
+        return;
+    }
+
+    doorbell_init(&proxy_log_doorbell);
+    pthread_key_create(&proxy_log_ring_key, proxy_log_ring_release);
+    proxy_log_writer_end = false;
+    if(pthread_create(&proxy_log_writer_thread, NULL, proxy_log_writer, NULL)!=0) {
+        pthread_key_delete(proxy_log_ring_key);
+        proxy_log("ERROR", "log writer thread creation is failed, %s", "logging synchronously");
+        return;
+    }
+    proxy_log_async = true;
+}
+
 void proxy_log_context_destroy() {
+    ProxyLogRing *ring, *next;
+
+    if(proxy_log_async) {
+        proxy_log_async = false;//later lines are written directly
+        proxy_log_writer_end = true;
+        doorbell_ring(&proxy_log_doorbell);
+        pthread_join(proxy_log_writer_thread, NULL);
+        for(ring=atomic_exchange(&proxy_log_rings, NULL); ring!=NULL; ring=next) {
+            next = ring->next;
+            free(ring);
+        }
+        atomic_fetch_add(&proxy_log_generation, 1);//other threads drop their stale ring pointer
+        proxy_log_local_ring = NULL;
+        pthread_key_delete(proxy_log_ring_key);
+    }
     if(has_proxy_log_lock) {
         pthread_mutex_destroy(&proxy_log_lock);
         has_proxy_log_lock = false;
@@ -46,33 +150,118 @@ void proxy_log_context_destroy() {
     proxy_log_path = NULL;
 }
 
+bool proxy_log_enabled(const char *level) {
+    return proxy_log_rank(level) >= proxy_log_min_rank;
+}
+
+void proxy_log_level_set(const char *level) {
+    proxy_log_min_rank = proxy_log_rank(level);
+}
+
 void proxy_log(const char *level, const char *fmt, ...) {
-    time_t t;
-	struct tm tm_now, tm_file;
-	char filepath[100], tmstr[TMSTRBUFLEN], *buf;
-	struct stat st;
-	int flags, filenum, n;
-	struct timespec *tspec;
     va_list args;
+
+    if(!proxy_log_enabled(level)) {
+        return;
+    }
+    va_start(args, fmt);
+    if(proxy_log_async) {
+        proxy_log_enqueue(level, fmt, args);
+    } else {
+        proxy_log_direct(level, fmt, args);
+    }
+    va_end(args);
+}
+
+//unknown levels are never filtered
+static int proxy_log_rank(const char *level) {
+    if(level==NULL) {
+        return PROXYLOG_ERROR;
+    }
+    if(strcmp(level, "DEBUG")==0) {
+        return PROXYLOG_DEBUG;
+    }
+    if(strcmp(level, "INFO")==0) {
+        return PROXYLOG_INFO;
+    }
+    if(strcmp(level, "WARNING")==0) {
+        return PROXYLOG_WARNING;
+    }
+    return PROXYLOG_ERROR;
+}
+
+//before proxy_log_configure, after proxy_log_context_destroy or with log_async 0
+static void proxy_log_direct(const char *level, const char *fmt, va_list args) {
+    time_t t;
+	struct tm tm_now;
+	char tmstr[TMSTRBUFLEN], *buf;
+	int filenum, n;
+    va_list args_copy;
     size_t size;
-    mode_t mode;
 
     if(has_proxy_log_lock) {
         pthread_mutex_lock(&proxy_log_lock);
     }
 
-    flags = 0;
     t = time(NULL);
-    tm_now = *localtime(&t);
-    strftime(tmstr, TMSTRBUFLEN, "%a", &tm_now);
-    sprintf(filepath, "%s/%s-%s.log", proxy_log_path, proxy_name, tmstr);
+    localtime_r(&t, &tm_now);
+    filenum = proxy_log_open(&tm_now);
+    if(filenum != -1) {
+        buf = NULL;
+        size = 0;
+
+        va_copy(args_copy, args);
+        n = vsnprintf(buf, size, fmt, args_copy);
+        va_end(args_copy);
+
+        size = (size_t) n + 1; //one extra byte for zero string terminator
+        buf = malloc(size);
+
+        if( buf != NULL ) {
+            n = vsnprintf(buf, size, fmt, args);
+
+            if( n > 0 ) {
+                strftime(tmstr, TMSTRBUFLEN, "%Y-%m-%d %H:%M:%S %Z", &tm_now);
+                write(filenum, tmstr, strlen(tmstr));
+                snprintf(tmstr, TMSTRBUFLEN, " [%d] ", proxy_log_pid);
+                write(filenum, tmstr, strlen(tmstr));
+                write(filenum, level, strlen(level));
+                write(filenum, ": ", 2);
+                write(filenum, buf, n);
+                write(filenum, "\n", 1);
+            }
+
+            free(buf);
+        }
+
+        close(filenum);
+    }
+
+    if(has_proxy_log_lock) {
+        pthread_mutex_unlock(&proxy_log_lock);
+    }
+}
+
+//one file per weekday, a file left from an earlier week is truncated
+static int proxy_log_open(const struct tm *tm_now) {
+    time_t t;
+	struct tm tm_file;
+	char filepath[100], tmstr[TMSTRBUFLEN];
+	struct stat st;
+	int flags;
+	struct timespec *tspec;
+    mode_t mode;
+
+    flags = 0;
+    strftime(tmstr, TMSTRBUFLEN, "%a", tm_now);
+    snprintf(filepath, sizeof(filepath), "%s/%s-%s.log", proxy_log_path, proxy_name, tmstr);
 
     mode = 0;
     if(stat(filepath, &st) == 0) {
         tspec = (struct timespec*)&birthtime(st);
 		t = tspec->tv_sec + (tspec->tv_nsec/1000000000);
-		tm_file = *localtime(&t);
-		if( tm_now.tm_year == tm_file.tm_year && tm_now.tm_mon == tm_file.tm_mon && tm_now.tm_mday == tm_file.tm_mday)
+		localtime_r(&t, &tm_file);
+		if( tm_now->tm_year == tm_file.tm_year && tm_now->tm_mon == tm_file.tm_mon && tm_now->tm_mday == tm_file.tm_mday)
 			flags = O_APPEND;
 		else
 			flags = O_TRUNC | O_APPEND;
@@ -83,45 +272,230 @@ void proxy_log(const char *level, const char *fmt, ...) {
         }
     }
 
-    if(flags!=0) {
-        filenum = open(filepath, flags | O_WRONLY, mode);
-		if(filenum != -1) {
-            buf = NULL;
-            size = 0;
+    return flags!=0 ? open(filepath, flags | O_WRONLY, mode) : -1;
+}
 
-            va_start(args, fmt);
-            n = vsnprintf(buf, size, fmt, args);
-            va_end(args);
-
-            size = (size_t) n + 1; //one extra byte for zero string terminator
-            buf = malloc(size);
-
-            if( buf != NULL ) {
-                va_start(args, fmt);
-                n = vsnprintf(buf, size, fmt, args);
-                va_end(args);
-
-                if( n > 0 ) {
-                    strftime(tmstr, TMSTRBUFLEN, "%Y-%m-%d %H:%M:%S %Z", &tm_now);
-                    write(filenum, tmstr, strlen(tmstr));
-                    snprintf(tmstr, TMSTRBUFLEN, " [%d] ", proxy_log_pid);
-                    write(filenum, tmstr, strlen(tmstr));
-                    write(filenum, level, strlen(level));
-                    write(filenum, ": ", 2);
-                    write(filenum, buf, n);
-                    write(filenum, "\n", 1);
-                }
-
-                free(buf);
+//never blocks, a full ring drops the line and the writer reports the count
+static void proxy_log_enqueue(const char *level, const char *fmt, va_list args) {
+    ProxyLogRing *ring;
+    ProxyLogRecord *record;
+    unsigned int head;
+    va_list args_copy;
+    int n;
+
+    if( (ring = proxy_log_thread_ring())==NULL ) {
+        atomic_fetch_add(&proxy_log_dropped, 1);
+        return;
+    }
+    head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if(head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= PROXYLOG_RING_RECORDS) {
+        atomic_fetch_add(&proxy_log_dropped, 1);
+        return;
+    }
+
+    record = &ring->records[head & (PROXYLOG_RING_RECORDS - 1)];
+    record->t = time(NULL);
+    snprintf(record->level, PROXYLOG_LEVEL_LEN, "%s", level);
+    record->long_text = NULL;
+    va_copy(args_copy, args);
+    n = vsnprintf(record->text, PROXYLOG_RECORD_TEXT, fmt, args_copy);
+    va_end(args_copy);
+    if(n < 0) {
+        n = 0;
+    } else if(n >= PROXYLOG_RECORD_TEXT) {
+        if( (record->long_text = (char*)malloc((size_t)n + 1))!=NULL ) {
+            vsnprintf(record->long_text, (size_t)n + 1, fmt, args);
+        } else {
+            n = PROXYLOG_RECORD_TEXT - 1;
+        }
+    }
+    record->length = (size_t)n;
+
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    doorbell_ring(&proxy_log_doorbell);
+}
+
+static ProxyLogRing *proxy_log_thread_ring(void) {
+    ProxyLogRing *ring;
+    bool expected;
+
+    if(proxy_log_local_ring!=NULL && proxy_log_local_generation==atomic_load_explicit(&proxy_log_generation, memory_order_relaxed)) {
+        return proxy_log_local_ring;
+    }
+    //reuse the ring of an exited thread first
+    for(ring=atomic_load(&proxy_log_rings); ring!=NULL; ring=ring->next) {
+        expected = false;
+        if(atomic_compare_exchange_strong(&ring->in_use, &expected, true)) {
+            break;
+        }
+    }
+    if(ring==NULL) {
+        if( (ring = (ProxyLogRing*)malloc(sizeof(ProxyLogRing)))==NULL ) {
+            return NULL;
+        }
+        atomic_init(&ring->head, 0);
+        atomic_init(&ring->tail, 0);
+        atomic_init(&ring->in_use, true);
+        ring->next = atomic_load(&proxy_log_rings);
+        while(!atomic_compare_exchange_weak(&proxy_log_rings, &ring->next, ring));
+    }
+    proxy_log_local_ring = ring;
+    proxy_log_local_generation = atomic_load(&proxy_log_generation);
+    pthread_setspecific(proxy_log_ring_key, ring);
+    return ring;
+}
+
+static void proxy_log_ring_release(void *ring) {
+    atomic_store(&((ProxyLogRing*)ring)->in_use, false);
+    proxy_log_local_ring = NULL;
+}
+
+static void *proxy_log_writer(void *arg) {
+    uint32_t sequence;
+
+    while(!proxy_log_writer_end) {
+        sequence = doorbell_sequence(&proxy_log_doorbell);
+        proxy_log_drain();
+        if(!proxy_log_writer_end) {
+            doorbell_wait(&proxy_log_doorbell, sequence);
+        }
+    }
+    proxy_log_drain();
+    if(proxy_log_fd!=-1) {
+        close(proxy_log_fd);
+        proxy_log_fd = -1;
+    }
+    pthread_exit(NULL);
+}
+
+static void proxy_log_drain(void) {
+    ProxyLogRing *ring;
+    unsigned int written;
+
+    do {
+        written = 0;
+        for(ring=atomic_load(&proxy_log_rings); ring!=NULL; ring=ring->next) {
+            written += proxy_log_drain_ring(ring);
+        }
+    } while(written>0);
+    proxy_log_report_dropped();
+}
+
+//lines of one ring are written in order, lines of different threads may interleave out of time order
+static unsigned int proxy_log_drain_ring(ProxyLogRing *ring) {
+    struct iovec iov[PROXYLOG_WRITE_LINES * 3];
+    char prefix[PROXYLOG_WRITE_LINES][TMSTRBUFLEN + PROXYLOG_LEVEL_LEN + 24];
+    ProxyLogRecord *record;
+    unsigned int tail, head, lines, i, written;
+    struct tm tm_record;
+    int len;
+
+    written = 0;
+    tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    while(tail!=head) {
+        lines = 0;
+        while(tail + lines!=head && lines<PROXYLOG_WRITE_LINES) {
+            record = &ring->records[(tail + lines) & (PROXYLOG_RING_RECORDS - 1)];
+            if(lines>0 && !proxy_log_day_open(record->t)) {
+                break;//lines of the earlier day are written to its file before switching
             }
+            if(!proxy_log_switch(record->t)) {
+                break;
+            }
+            localtime_r(&record->t, &tm_record);
+            len = (int)strftime(prefix[lines], TMSTRBUFLEN, "%Y-%m-%d %H:%M:%S %Z", &tm_record);
+            len += snprintf(prefix[lines] + len, sizeof(prefix[lines]) - len, " [%d] %s: ", proxy_log_pid, record->level);
+            iov[lines * 3].iov_base = prefix[lines];
+            iov[lines * 3].iov_len = (size_t)len;
+            iov[lines * 3 + 1].iov_base = record->long_text!=NULL ? record->long_text : record->text;
+            iov[lines * 3 + 1].iov_len = record->length;
+            iov[lines * 3 + 2].iov_base = "\n";
+            iov[lines * 3 + 2].iov_len = 1;
+            lines++;
+        }
+        if(lines>0) {
+            proxy_log_writev(iov, (int)lines * 3);
+        } else {
+            lines = 1;//the log file cannot be opened, drop the record
+        }
+        for(i=0; i<lines; i++) {
+            record = &ring->records[(tail + i) & (PROXYLOG_RING_RECORDS - 1)];
+            free(record->long_text);
+            record->long_text = NULL;
+        }
+        tail += lines;
+        written += lines;
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+        head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    }
+    return written;
+}
 
-			close(filenum);
-		}
+static void proxy_log_writev(struct iovec *iov, int iovcnt) {
+    ssize_t n;
+
+    while(iovcnt>0) {
+        n = writev(proxy_log_fd, iov, iovcnt);
+        if(n<0) {
+            if(errno==EINTR) {
+                continue;
+            }
+            return;
+        }
+        while(iovcnt>0 && (size_t)n>=iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if(iovcnt>0) {
+            iov->iov_base = (char*)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
     }
+}
 
-    if(has_proxy_log_lock) {
-        pthread_mutex_unlock(&proxy_log_lock);
+//the open file is the one of the day of t
+static bool proxy_log_day_open(time_t t) {
+    struct tm tm_now;
+
+    localtime_r(&t, &tm_now);
+    return proxy_log_fd!=-1 && tm_now.tm_yday==proxy_log_fd_yday && tm_now.tm_year==proxy_log_fd_year;
+}
+
+//keep the file open for the day of t, false when it cannot be opened
+static bool proxy_log_switch(time_t t) {
+    struct tm tm_now;
+
+    if(proxy_log_day_open(t)) {
+        return true;
     }
+    localtime_r(&t, &tm_now);
+    if(proxy_log_fd!=-1) {
+        close(proxy_log_fd);
+    }
+    proxy_log_fd = proxy_log_open(&tm_now);
+    proxy_log_fd_yday = tm_now.tm_yday;
+    proxy_log_fd_year = tm_now.tm_year;
+    return proxy_log_fd!=-1;
+}
+
+static void proxy_log_report_dropped(void) {
+    char line[TMSTRBUFLEN + 80];
+    struct tm tm_now;
+    unsigned int dropped;
+    time_t t;
+    int len;
 
-    return;
+    if( (dropped = atomic_exchange(&proxy_log_dropped, 0))<1 ) {
+        return;
+    }
+    t = time(NULL);
+    if(!proxy_log_switch(t)) {
+        return;
+    }
+    localtime_r(&t, &tm_now);
+    len = (int)strftime(line, TMSTRBUFLEN, "%Y-%m-%d %H:%M:%S %Z", &tm_now);
+    len += snprintf(line + len, sizeof(line) - len, " [%d] WARNING: %u log lines dropped\n", proxy_log_pid, dropped);
+    write(proxy_log_fd, line, len);
 }
\ No newline at end of file
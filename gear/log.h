@@ -2,11 +2,16 @@
 #define _SAWANG_LOG_H_
 
 #include <pthread.h>
+#include <stdbool.h>
 
 #include "define.h"
+#include "confvar.h"
 
 extern void proxy_log_context_init(pid_t pid, const char *path);
+extern void proxy_log_configure(const ConfVar *cv_head);//level filter and the background writer
 extern void proxy_log_context_destroy();
 extern void proxy_log(const char *level, const char *fmt, ...);
+extern bool proxy_log_enabled(const char *level);//level is DEBUG, INFO, WARNING or ERROR
+extern void proxy_log_level_set(const char *level);//lines below level are discarded before formatting
 
 #endif //_SAWANG_LOG_H_
\ No newline at end of file
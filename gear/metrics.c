@@ -0,0 +1,135 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "define.h"
+#include "log.h"
+#include "globaldata.h"
+#include "metrics.h"
+
+//property
+static char *metrics_path = NULL;
+static MetricsShm *metrics_shm = NULL;
+
+//function
+static unsigned int metrics_bucket(uint64_t ns);
+
+bool metrics_context_init(const ConfVar *cv_head, pid_t pid) {
+    char buff[PROXYLOGBUFLEN];
+    unsigned int enabled;
+    int fd;
+
+    if(metrics_shm!=NULL) {
+        return true;
+    }
+    if(confvar_uint(cv_head, CONF_METRICS, &enabled) && enabled<1) {
+        return true;
+    }
+
+    metrics_path = (char*)malloc(strlen(proxy_name) + strlen(METRICS_SUFFIX) + 2);
+    sprintf(metrics_path, "/%s%s", proxy_name, METRICS_SUFFIX);
+
+    do {
+        fd = shm_open(metrics_path, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR | S_IRGRP);
+        if(fd==-1) {
+            strerror_r(errno, buff, PROXYLOGBUFLEN);
+            proxy_log("ERROR", "metrics shm %s creation is failed %s", metrics_path, buff);
+            break;
+        }
+        if(ftruncate(fd, sizeof(MetricsShm))==-1) {
+            strerror_r(errno, buff, PROXYLOGBUFLEN);
+            proxy_log("ERROR", "metrics shm %s truncation is failed %s", metrics_path, buff);
+            close(fd);
+            shm_unlink(metrics_path);
+            break;
+        }
+        metrics_shm = (MetricsShm*)mmap(NULL, sizeof(MetricsShm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if(metrics_shm==MAP_FAILED) {
+            metrics_shm = NULL;
+            strerror_r(errno, buff, PROXYLOGBUFLEN);
+            proxy_log("ERROR", "metrics shm %s mapping is failed %s", metrics_path, buff);
+            shm_unlink(metrics_path);
+            break;
+        }
+
+        memset(metrics_shm, 0, sizeof(MetricsShm));//a segment left by a crashed proxy starts over
+        metrics_shm->version = METRICS_VERSION;
+        metrics_shm->pid = pid;
+        metrics_shm->started = (int64_t)time(NULL);
+        metrics_shm->counter_count = METRICS_COUNTER_COUNT;
+        metrics_shm->histogram_count = METRICS_HISTOGRAM_COUNT;
+        metrics_shm->bucket_count = METRICS_BUCKETS;
+        atomic_thread_fence(memory_order_release);
+        metrics_shm->magic = METRICS_MAGIC;//readers check it last
+        return true;
+    } while(false);
+
+    free(metrics_path);
+    metrics_path = NULL;
+    return false;
+}
+
+void metrics_context_destroy(void) {
+    if(metrics_shm!=NULL) {
+        munmap(metrics_shm, sizeof(MetricsShm));
+        metrics_shm = NULL;
+    }
+    if(metrics_path!=NULL) {
+        shm_unlink(metrics_path);
+        free(metrics_path);
+        metrics_path = NULL;
+    }
+}
+
+void metrics_add(enum MetricsCounter counter, int64_t n) {
+    if(metrics_shm!=NULL) {
+        atomic_fetch_add_explicit(&metrics_shm->counters[counter], n, memory_order_relaxed);
+    }
+}
+
+int64_t metrics_value(enum MetricsCounter counter) {
+    return metrics_shm!=NULL ? atomic_load_explicit(&metrics_shm->counters[counter], memory_order_relaxed) : 0;
+}
+
+uint64_t metrics_now(void) {
+    struct timespec ts;
+
+    if(metrics_shm==NULL) {
+        return 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void metrics_observe(enum MetricsHistogram histogram, uint64_t start) {
+    MetricsHistogramShm *h;
+    uint64_t ns;
+
+    if(metrics_shm==NULL || start==0) {
+        return;
+    }
+    ns = metrics_now() - start;
+    h = &metrics_shm->histograms[histogram];
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum_ns, ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->buckets[metrics_bucket(ns)], 1, memory_order_relaxed);
+}
+
+static unsigned int metrics_bucket(uint64_t ns) {
+    uint64_t us;
+    unsigned int bucket;
+
+    us = ns / 1000;
+    if(us==0) {
+        return 0;
+    }
+    bucket = 64 - (unsigned int)__builtin_clzll(us);
+    return bucket<METRICS_BUCKETS ? bucket : METRICS_BUCKETS - 1;
+}
\ No newline at end of file
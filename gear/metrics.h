@@ -0,0 +1,79 @@
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "confvar.h"
+
+//layout of the /<proxy>_metrics shared memory, readers map it read only and never lock
+#define METRICS_SUFFIX "_metrics"
+#define METRICS_MAGIC 0x4d475753u
+#define METRICS_VERSION 1
+#define METRICS_BUCKETS 32//bucket 0 is below 1us, bucket i holds [2^(i-1), 2^i) us, the last one is open ended
+
+enum MetricsCounter {
+    METRICS_REQUEST_SINGLESHOT = 0,//dispatched with PARSE_SINGLESHOT
+    METRICS_REQUEST_MULTIRESPOND,//dispatched with PARSE_MULTIRESPOND
+    METRICS_REQUEST_MULTIRESPOND_JOINED,//multirespond served by an already running task
+    METRICS_REQUEST_UNSUBSCRIBE,
+    METRICS_REQUEST_INVALID,//PARSE_INVALID or a refused unsubscribe
+    METRICS_REQUEST_UNREADABLE,//payload could not be read or parsed
+    METRICS_REQUEST_REST,
+    METRICS_PARSE_QUEUE_PUSHED,
+    METRICS_PARSE_QUEUE_POPPED,
+    METRICS_REPLY_QUEUE_PUSHED,
+    METRICS_REPLY_QUEUE_POPPED,
+    //gauges
+    METRICS_SINGLESHOT_TASKS,
+    METRICS_SINGLESHOT_REQUESTS,
+    METRICS_MULTIRESPOND_TASKS,
+    METRICS_MULTIRESPOND_REQUESTS,
+    METRICS_COUNTER_COUNT
+};
+
+#define METRICS_COUNTER_NAMES { \
+    "request_singleshot", "request_multirespond", "request_multirespond_joined", "request_unsubscribe", \
+    "request_invalid", "request_unreadable", "request_rest", \
+    "parse_queue_pushed", "parse_queue_popped", "reply_queue_pushed", "reply_queue_popped", \
+    "singleshot_tasks", "singleshot_requests", "multirespond_tasks", "multirespond_requests" }
+
+enum MetricsHistogram {
+    METRICS_CHANNEL_HANDSHAKE = 0,//acknowledge to done
+    METRICS_SUBSCRIBE_HANDSHAKE,//answer to acknowledgement
+    METRICS_REST_HANDSHAKE,//respond to acknowledgement
+    METRICS_PROXY_RUN,
+    METRICS_PAYLOAD_PARSE,
+    METRICS_HISTOGRAM_COUNT
+};
+
+#define METRICS_HISTOGRAM_NAMES { "channel_handshake", "subscribe_handshake", "rest_handshake", "proxy_run", "payload_parse" }
+
+typedef struct MetricsHistogramShm {
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum_ns;
+    _Atomic uint64_t buckets[METRICS_BUCKETS];
+} __attribute__((aligned(64))) MetricsHistogramShm;
+
+typedef struct MetricsShm {
+    uint32_t magic;
+    uint32_t version;
+    pid_t pid;
+    int64_t started;//unix seconds
+    uint32_t counter_count;
+    uint32_t histogram_count;
+    uint32_t bucket_count;
+    _Atomic int64_t counters[METRICS_COUNTER_COUNT] __attribute__((aligned(64)));
+    MetricsHistogramShm histograms[METRICS_HISTOGRAM_COUNT];
+} MetricsShm;
+
+extern bool metrics_context_init(const ConfVar *cv_head, pid_t pid);
+extern void metrics_context_destroy(void);
+extern void metrics_add(enum MetricsCounter counter, int64_t n);
+extern int64_t metrics_value(enum MetricsCounter counter);//0 when metrics is disabled
+extern uint64_t metrics_now(void);//monotonic ns, vdso clock without syscall
+extern void metrics_observe(enum MetricsHistogram histogram, uint64_t start);//record metrics_now() - start
+
+#endif //_METRICS_H_
\ No newline at end of file
@@ -0,0 +1,66 @@
+#include <sched.h>
+
+#include "mpscqueue.h"
+
+//function
+static void mpsc_queue_link(MpscQueue *q, MpscNode *node);
+
+void mpsc_queue_init(MpscQueue *q) {
+    atomic_init(&q->stub.next, NULL);
+    atomic_init(&q->head, &q->stub);
+    atomic_init(&q->depth, 0);
+    q->tail = &q->stub;
+}
+
+//counted before it is published, so the consumer never takes the depth below zero
+void mpsc_queue_push(MpscQueue *q, MpscNode *node) {
+    atomic_fetch_add_explicit(&q->depth, 1, memory_order_relaxed);
+    mpsc_queue_link(q, node);
+}
+
+MpscNode *mpsc_queue_pop(MpscQueue *q) {
+    MpscNode *tail, *next;
+
+    tail = q->tail;
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if(tail==&q->stub) {
+        if(next==NULL) {
+            return NULL;
+        }
+        q->tail = next;
+        tail = next;
+        next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    }
+    if(next==NULL) {
+        if(tail!=atomic_load_explicit(&q->head, memory_order_acquire)) {
+            //a producer swapped head but has not linked yet, it is a few instructions away
+            while((next = atomic_load_explicit(&tail->next, memory_order_acquire))==NULL) {
+                sched_yield();
+            }
+        } else {
+            //tail is the last node, park the stub behind it so tail can be handed out
+            mpsc_queue_link(q, &q->stub);
+            next = atomic_load_explicit(&tail->next, memory_order_acquire);
+            while(next==NULL) {
+                sched_yield();
+                next = atomic_load_explicit(&tail->next, memory_order_acquire);
+            }
+        }
+    }
+    q->tail = next;
+    atomic_fetch_sub_explicit(&q->depth, 1, memory_order_relaxed);
+    return tail;
+}
+
+int64_t mpsc_queue_depth(MpscQueue *q) {
+    return atomic_load_explicit(&q->depth, memory_order_relaxed);
+}
+
+//one exchange publishes the node, the link from its predecessor follows right after
+static void mpsc_queue_link(MpscQueue *q, MpscNode *node) {
+    MpscNode *prev;
+
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    prev = atomic_exchange_explicit(&q->head, node, memory_order_acq_rel);
+    atomic_store_explicit(&prev->next, node, memory_order_release);
+}
\ No newline at end of file
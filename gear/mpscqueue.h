@@ -0,0 +1,29 @@
+#ifndef _MPSCQUEUE_H_
+#define _MPSCQUEUE_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//intrusive node, embedded as the first member of a queued task
+typedef struct MpscNode {
+    _Atomic(struct MpscNode*) next;
+} MpscNode;
+
+//unbounded multi producer single consumer queue, push and pop neither lock nor allocate
+typedef struct MpscQueue {
+    _Atomic(MpscNode*) head;//producers side
+    _Atomic int64_t depth;//pushed minus popped, relaxed, only for probes and metrics
+    MpscNode *tail;//consumer side
+    MpscNode stub;
+} MpscQueue;
+
+#define MPSC_CONTAINER(ptr, type) ((type*)((char*)(ptr) - offsetof(type, node)))
+
+extern void mpsc_queue_init(MpscQueue *q);
+extern void mpsc_queue_push(MpscQueue *q, MpscNode *node);//any thread
+extern MpscNode *mpsc_queue_pop(MpscQueue *q);//consumer thread only, NULL when empty
+extern int64_t mpsc_queue_depth(MpscQueue *q);//any thread, approximate while producers push
+
+#endif //_MPSCQUEUE_H_
\ No newline at end of file
@@ -0,0 +1,199 @@
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "objectpool.h"
+
+#define OBJECTPOOL_MAGAZINE 64//objects moved per depot exchange
+#define OBJECTPOOL_DEPOT_MAX 64//magazines kept per kind, further objects go back to malloc
+
+//overlays a free object, every pooled type is at least two pointers wide
+typedef struct ObjectPoolFree {
+    struct ObjectPoolFree *next;
+    struct ObjectPoolFree *next_magazine;//only on the first object of a magazine in the depot
+} ObjectPoolFree;
+
+typedef struct ObjectPoolCache {
+    ObjectPoolFree *head;
+    guint count;
+} ObjectPoolCache;
+
+typedef struct ObjectPoolDepot {
+    pthread_mutex_t lock;
+    ObjectPoolFree *magazines;
+    guint count;
+} ObjectPoolDepot;
+
+//property
+static volatile bool object_pool_created = false;
+static ObjectPoolDepot object_pool_depot[OBJECTPOOL_KIND_COUNT];
+static pthread_key_t object_pool_key;//flush a thread cache on thread exit
+static __thread ObjectPoolCache object_pool_cache[OBJECTPOOL_KIND_COUNT];
+static __thread bool object_pool_cache_registered = false;
+
+//function
+static ObjectPoolCache *object_pool_thread_cache(enum ObjectPoolKind kind);
+static void object_pool_refill(enum ObjectPoolKind kind, ObjectPoolCache *cache);
+static void object_pool_spill(enum ObjectPoolKind kind, ObjectPoolCache *cache);
+static void object_pool_free_list(ObjectPoolFree *head);
+static void object_pool_thread_exit(void *cache);
+
+void object_pool_create(void) {
+    pthread_mutexattr_t mtx_attr;
+    guint i;
+
+    if(!object_pool_created) {
+        pthread_mutexattr_init(&mtx_attr);
+        pthread_mutexattr_setpshared(&mtx_attr, PTHREAD_PROCESS_PRIVATE);
+        pthread_mutexattr_settype(&mtx_attr, PTHREAD_MUTEX_NORMAL);
+        for(i=0; i<OBJECTPOOL_KIND_COUNT; i++) {
+            pthread_mutex_init(&object_pool_depot[i].lock, &mtx_attr);
+            object_pool_depot[i].magazines = NULL;
+            object_pool_depot[i].count = 0;
+        }
+        pthread_mutexattr_destroy(&mtx_attr);
+
+        pthread_key_create(&object_pool_key, object_pool_thread_exit);
+        object_pool_created = true;
+    }
+}
+
+//every pool user thread is joined by now, except the caller whose cache is flushed here
+void object_pool_destroy(void) {
+    ObjectPoolFree *magazine, *next_magazine;
+    guint i;
+
+    if(object_pool_created) {
+        object_pool_created = false;
+        if(object_pool_cache_registered) {
+            object_pool_thread_exit(object_pool_cache);
+        }
+        for(i=0; i<OBJECTPOOL_KIND_COUNT; i++) {
+            for(magazine=object_pool_depot[i].magazines; magazine!=NULL; magazine=next_magazine) {
+                next_magazine = magazine->next_magazine;
+                object_pool_free_list(magazine);
+            }
+            object_pool_depot[i].magazines = NULL;
+            object_pool_depot[i].count = 0;
+            pthread_mutex_destroy(&object_pool_depot[i].lock);
+        }
+        pthread_key_delete(object_pool_key);
+    }
+}
+
+void *object_pool_alloc(enum ObjectPoolKind kind, size_t size) {
+    ObjectPoolCache *cache;
+    ObjectPoolFree *object;
+
+    if(!object_pool_created) {
+        return malloc(size);
+    }
+    cache = object_pool_thread_cache(kind);
+    if(cache->head==NULL) {
+        object_pool_refill(kind, cache);
+    }
+    if( (object = cache->head)!=NULL ) {
+        cache->head = object->next;
+        cache->count--;
+        return object;
+    }
+    return malloc(size);
+}
+
+void object_pool_free(enum ObjectPoolKind kind, void *object) {
+    ObjectPoolCache *cache;
+    ObjectPoolFree *f;
+
+    if(object==NULL) {
+        return;
+    }
+    if(!object_pool_created) {
+        free(object);
+        return;
+    }
+    cache = object_pool_thread_cache(kind);
+    f = (ObjectPoolFree*)object;
+    f->next = cache->head;
+    cache->head = f;
+    cache->count++;
+    //a consumer thread frees what producers allocate, hand the surplus over in whole magazines
+    if(cache->count >= 2 * OBJECTPOOL_MAGAZINE) {
+        object_pool_spill(kind, cache);
+    }
+}
+
+static ObjectPoolCache *object_pool_thread_cache(enum ObjectPoolKind kind) {
+    if(!object_pool_cache_registered) {
+        pthread_setspecific(object_pool_key, object_pool_cache);
+        object_pool_cache_registered = true;
+    }
+    return &object_pool_cache[kind];
+}
+
+static void object_pool_refill(enum ObjectPoolKind kind, ObjectPoolCache *cache) {
+    ObjectPoolDepot *depot;
+    ObjectPoolFree *magazine;
+
+    depot = &object_pool_depot[kind];
+    pthread_mutex_lock(&depot->lock);
+    if( (magazine = depot->magazines)!=NULL ) {
+        depot->magazines = magazine->next_magazine;
+        depot->count--;
+    }
+    pthread_mutex_unlock(&depot->lock);
+
+    if(magazine!=NULL) {
+        cache->head = magazine;
+        cache->count = OBJECTPOOL_MAGAZINE;
+    }
+}
+
+static void object_pool_spill(enum ObjectPoolKind kind, ObjectPoolCache *cache) {
+    ObjectPoolDepot *depot;
+    ObjectPoolFree *magazine, *last;
+    guint i;
+    bool kept;
+
+    magazine = cache->head;
+    last = magazine;
+    for(i=1; i<OBJECTPOOL_MAGAZINE; i++) {
+        last = last->next;
+    }
+    cache->head = last->next;
+    cache->count -= OBJECTPOOL_MAGAZINE;
+    last->next = NULL;
+
+    depot = &object_pool_depot[kind];
+    pthread_mutex_lock(&depot->lock);
+    if( (kept = depot->count<OBJECTPOOL_DEPOT_MAX) ) {
+        magazine->next_magazine = depot->magazines;
+        depot->magazines = magazine;
+        depot->count++;
+    }
+    pthread_mutex_unlock(&depot->lock);
+
+    if(!kept) {
+        object_pool_free_list(magazine);
+    }
+}
+
+static void object_pool_free_list(ObjectPoolFree *head) {
+    ObjectPoolFree *next;
+
+    for(; head!=NULL; head=next) {
+        next = head->next;
+        free(head);
+    }
+}
+
+static void object_pool_thread_exit(void *cache) {
+    ObjectPoolCache *c;
+    guint i;
+
+    c = (ObjectPoolCache*)cache;
+    for(i=0; i<OBJECTPOOL_KIND_COUNT; i++) {
+        object_pool_free_list(c[i].head);
+        c[i].head = NULL;
+        c[i].count = 0;
+    }
+    object_pool_cache_registered = false;
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#ifndef _OBJECTPOOL_H_
+#define _OBJECTPOOL_H_
+
+#include <pthread.h>
+#include <stddef.h>
+#include <glib.h>
+
+//fixed size object recycling for the per message tasks
+//each thread keeps a private free list, whole magazines move through the shared depot under one lock
+//so an object freed on the consumer thread finds its way back to the producer threads
+enum ObjectPoolKind {
+    OBJECTPOOL_PROXY_TASK = 0,
+    OBJECTPOOL_PARSE_TASK,
+    OBJECTPOOL_REPLY_TASK,
+    OBJECTPOOL_KIND_COUNT
+};
+
+extern void object_pool_create(void);
+extern void object_pool_destroy(void);
+extern void *object_pool_alloc(enum ObjectPoolKind kind, size_t size);//size is the same for every call of a kind
+extern void object_pool_free(enum ObjectPoolKind kind, void *object);
+
+#endif //_OBJECTPOOL_H_
\ No newline at end of file
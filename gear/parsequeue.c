@@ -1,66 +1,78 @@
 #include <glib.h>
 
 #include "parsequeue.h"
+#include "objectpool.h"
+#include "metrics.h"
+#include "trace.h"
+#include "probe.h"
 
-static GQueue *parse_queue = NULL;
-static pthread_mutex_t parse_queue_lock;
+//channel lanes and parse workers produce, proxycomm consumes
+static MpscQueue parse_queue;
+static bool parse_queue_created = false;
 
 void parse_queue_create(void) {
-    pthread_mutexattr_t mtx_attr;
-
-    if(parse_queue==NULL) {
-        pthread_mutexattr_init(&mtx_attr);
-        pthread_mutexattr_setpshared(&mtx_attr, PTHREAD_PROCESS_PRIVATE);
-        pthread_mutexattr_settype(&mtx_attr, PTHREAD_MUTEX_NORMAL);
-        pthread_mutex_init(&parse_queue_lock, &mtx_attr);
-        pthread_mutexattr_destroy(&mtx_attr);
-
-        parse_queue = g_queue_new();
+    if(!parse_queue_created) {
+        mpsc_queue_init(&parse_queue);
+        parse_queue_created = true;
     }
 }
 
 void parse_queue_destroy(void) {
-    if(parse_queue!=NULL) {
-        g_queue_free_full(parse_queue, (GDestroyNotify)parse_queue_task_destroy);
-        parse_queue = NULL;
-        pthread_mutex_destroy(&parse_queue_lock);
+    ParseQueueTask *t;
+
+    if(parse_queue_created) {
+        while( (t = parse_queue_pop_head())!=NULL ) {
+            parse_queue_task_destroy(t);
+        }
+        parse_queue_created = false;
     }
 }
 
-void parse_queue_append(const char *task_key, const char *unsubscribe_task_key, const char *unsubscribe_uuid, enum RespondTableType type) {
+//take over task
+void parse_queue_append(ProxyTask *task, TaskKey *unsubscribe_task_key, const char *unsubscribe_uuid, enum RespondTableType type) {
     ParseQueueTask *t;
+    size_t length;
 
-    t = (ParseQueueTask*)malloc(sizeof(ParseQueueTask));
-    t->task_key = strdup(task_key);
-    t->unsubscribe_task_key = unsubscribe_task_key!=NULL && strlen(unsubscribe_task_key)>0 ? strdup(unsubscribe_task_key) : NULL;
-    t->unsubscribe_uuid = unsubscribe_uuid!=NULL && strlen(unsubscribe_uuid)>0 ? strdup(unsubscribe_uuid) : NULL;
+    t = (ParseQueueTask*)object_pool_alloc(OBJECTPOOL_PARSE_TASK, sizeof(ParseQueueTask));
+    t->task = task;
+    t->unsubscribe_task_key = unsubscribe_task_key!=NULL ? task_key_ref(unsubscribe_task_key) : NULL;
+    length = unsubscribe_uuid!=NULL ? strlen(unsubscribe_uuid) : 0;
+    if(length<1) {
+        t->unsubscribe_uuid = NULL;
+    } else if(length<UUIDBUFLEN) {
+        t->unsubscribe_uuid = memcpy(t->unsubscribe_uuid_buff, unsubscribe_uuid, length + 1);
+    } else {
+        t->unsubscribe_uuid = strdup(unsubscribe_uuid);
+    }
     t->type = t->unsubscribe_task_key!=NULL ? RESPONDTABLE_SINGLESHOT : type;
+    trace_mark(&task->trace);//parse queue wait starts
 
-    pthread_mutex_lock(&parse_queue_lock);
-    g_queue_push_tail(parse_queue, t);
-    pthread_mutex_unlock(&parse_queue_lock);
+    mpsc_queue_push(&parse_queue, &t->node);
+    metrics_add(METRICS_PARSE_QUEUE_PUSHED, 1);
+    SAWANG_PROBE(parse__queue__push, task->arg.service, parse_queue_depth());
 }
 
 ParseQueueTask *parse_queue_pop_head() {
-    ParseQueueTask *t;
+    MpscNode *node;
+
+    if( (node = mpsc_queue_pop(&parse_queue))==NULL ) {
+        return NULL;
+    }
+    metrics_add(METRICS_PARSE_QUEUE_POPPED, 1);
+    return MPSC_CONTAINER(node, ParseQueueTask);
+}
 
-    pthread_mutex_lock(&parse_queue_lock);
-    t = (ParseQueueTask*)g_queue_pop_head(parse_queue);
-    pthread_mutex_unlock(&parse_queue_lock);
-    return t;
+int64_t parse_queue_depth(void) {
+    return mpsc_queue_depth(&parse_queue);
 }
 
 void parse_queue_task_destroy(ParseQueueTask* task) {
     if(task!=NULL) {
-        if(task->task_key!=NULL) {
-            free(task->task_key);
-        }
-        if(task->unsubscribe_task_key!=NULL) {
-            free(task->unsubscribe_task_key);
-        }
-        if(task->unsubscribe_uuid!=NULL) {
+        proxy_task_destroy(task->task);
+        task_key_unref(task->unsubscribe_task_key);
+        if(task->unsubscribe_uuid!=NULL && task->unsubscribe_uuid!=task->unsubscribe_uuid_buff) {
             free(task->unsubscribe_uuid);
         }
-        free(task);
+        object_pool_free(OBJECTPOOL_PARSE_TASK, task);
     }
 }
\ No newline at end of file
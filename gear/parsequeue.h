@@ -2,18 +2,24 @@
 #define _PARSEQUEUE_H_
 
 #include "respondtable.h"
+#include "proxytask.h"
+#include "mpscqueue.h"
+#include "define.h"
 
 typedef struct ParseQueueTask {
-    char *task_key;
-    char *unsubscribe_task_key;
-    char *unsubscribe_uuid;
+    MpscNode node;
+    ProxyTask *task;
+    TaskKey *unsubscribe_task_key;
+    char *unsubscribe_uuid;//points to unsubscribe_uuid_buff unless the text is longer than a uuid
+    char unsubscribe_uuid_buff[UUIDBUFLEN];
     enum RespondTableType type;
 } ParseQueueTask;
 
 extern void parse_queue_create(void);
 extern void parse_queue_destroy(void);
-extern void parse_queue_append(const char *task_key, const char *unsubscribe_task_key, const char *unsubscribe_uuid, enum RespondTableType type);
+extern void parse_queue_append(ProxyTask *task, TaskKey *unsubscribe_task_key, const char *unsubscribe_uuid, enum RespondTableType type);
 extern ParseQueueTask *parse_queue_pop_head();
+extern int64_t parse_queue_depth(void);//kept by the queue, whether metrics is enabled or not
 extern void parse_queue_task_destroy(ParseQueueTask* task);
 
 #endif //_PARSEQUEUE_H_
\ No newline at end of file
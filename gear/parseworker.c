@@ -0,0 +1,209 @@
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <glib.h>
+
+#include "log.h"
+#include "define.h"
+#include "globaldata.h"
+#include "cJSON.h"
+#include "replyqueue.h"
+#include "proxycomm.h"
+#include "proxysubscribe.h"
+#include "proxyservicestatus.h"
+#include "channelrequest.h"
+#include "parseworker.h"
+
+#define PARSE_WORKERS_MAX 64
+
+typedef struct ParseWorkerJob {
+    char rid[UUIDBUFLEN];
+    char *text;
+    size_t length;
+    unsigned long ticket;
+    TraceContext trace;
+} ParseWorkerJob;
+
+//property
+static unsigned int parse_worker_total = 0;
+static volatile bool *parse_worker_started = NULL;
+static atomic_bool parse_worker_end = false;//read under both parse_worker_lock and parse_worker_dispatch_lock
+static GQueue *parse_worker_jobs = NULL;
+static pthread_mutex_t parse_worker_lock;
+static pthread_cond_t parse_worker_wakeup;
+static unsigned long parse_worker_next_ticket = 0;//ticket given to the next submitted job
+static pthread_mutex_t parse_worker_dispatch_lock;
+static pthread_cond_t parse_worker_dispatch_turn;
+static unsigned long parse_worker_dispatch_ticket = 0;//ticket allowed to dispatch
+
+//function
+static ParseWorkerJob* parse_worker_pop(void);
+static void parse_worker_process(ParseWorkerJob *job);
+static void parse_worker_job_destroy(ParseWorkerJob *job);
+
+void parse_worker_context_init(const ConfVar *cv_head) {
+    pthread_mutexattr_t mutexattr;
+    pthread_condattr_t condattr;
+
+    if(!confvar_uint(cv_head, CONF_PARSE_WORKERS, &parse_worker_total)) {
+        parse_worker_total = 0;//parse on the channel thread
+    } else if(parse_worker_total>PARSE_WORKERS_MAX) {
+        proxy_log("ERROR", "proxy %s %s %u is capped to %d", proxy_name, CONF_PARSE_WORKERS, parse_worker_total, PARSE_WORKERS_MAX);
+        parse_worker_total = PARSE_WORKERS_MAX;
+    }
+    if(parse_worker_total<1) {
+        return;
+    }
+
+    parse_worker_started = (volatile bool*)calloc(parse_worker_total, sizeof(bool));
+    parse_worker_jobs = g_queue_new();
+
+    pthread_mutexattr_init(&mutexattr);
+    pthread_mutexattr_setpshared(&mutexattr, PTHREAD_PROCESS_PRIVATE);
+    pthread_mutexattr_settype(&mutexattr, PTHREAD_MUTEX_NORMAL);
+    pthread_mutex_init(&parse_worker_lock, &mutexattr);
+    pthread_mutex_init(&parse_worker_dispatch_lock, &mutexattr);
+    pthread_mutexattr_destroy(&mutexattr);//mutexattr is no longer needed
+
+    pthread_condattr_init(&condattr);
+    pthread_condattr_setpshared(&condattr, PTHREAD_PROCESS_PRIVATE);
+    pthread_cond_init(&parse_worker_wakeup, &condattr);
+    pthread_cond_init(&parse_worker_dispatch_turn, &condattr);
+    pthread_condattr_destroy(&condattr);//condattr is no longer needed
+}
+
+void parse_worker_context_destroy(void) {
+    if(parse_worker_jobs!=NULL) {
+        g_queue_free_full(parse_worker_jobs, (GDestroyNotify)parse_worker_job_destroy);
+        parse_worker_jobs = NULL;
+        free((void*)parse_worker_started);
+        parse_worker_started = NULL;
+        pthread_mutex_destroy(&parse_worker_lock);
+        pthread_cond_destroy(&parse_worker_wakeup);
+        pthread_mutex_destroy(&parse_worker_dispatch_lock);
+        pthread_cond_destroy(&parse_worker_dispatch_turn);
+    }
+    parse_worker_total = 0;
+}
+
+unsigned int parse_worker_count(void) {
+    return parse_worker_total;
+}
+
+void parse_worker_submit(const char *rid, char *text, size_t length, const TraceContext *trace) {
+    ParseWorkerJob *job;
+
+    job = (ParseWorkerJob*)malloc(sizeof(ParseWorkerJob));
+    strncpy(job->rid, rid, UUIDBUFLEN - 1);
+    job->rid[UUIDBUFLEN - 1] = 0;
+    job->text = text;
+    job->length = length;
+    job->trace = *trace;
+
+    pthread_mutex_lock(&parse_worker_lock);
+    job->ticket = parse_worker_next_ticket++;
+    g_queue_push_tail(parse_worker_jobs, job);
+    pthread_cond_signal(&parse_worker_wakeup);
+    pthread_mutex_unlock(&parse_worker_lock);
+}
+
+void* parse_worker(void *arg) {
+    unsigned int index;
+    ParseWorkerJob *job;
+
+    index = (unsigned int)(uintptr_t)arg;
+    proxy_log("INFO", "proxy %s parse worker %u thread is started", proxy_name, index);
+    parse_worker_started[index] = true;
+
+    while( (job=parse_worker_pop())!=NULL ) {
+        parse_worker_process(job);
+        parse_worker_job_destroy(job);
+    }
+
+    proxy_log("INFO", "proxy %s parse worker %u thread is stopped", proxy_name, index);
+    pthread_exit(NULL);
+}
+
+void parse_worker_waitfor_started(unsigned int worker_index) {
+	while(!parse_worker_started[worker_index]) {
+		usleep(1000);
+	}
+}
+
+bool parse_worker_isstarted(unsigned int worker_index) {
+    return parse_worker_started!=NULL && worker_index<parse_worker_total && parse_worker_started[worker_index];
+}
+
+void parse_worker_stop(void) {
+    if(parse_worker_jobs==NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&parse_worker_lock);
+    atomic_store(&parse_worker_end, true);
+    pthread_cond_broadcast(&parse_worker_wakeup);
+    pthread_mutex_unlock(&parse_worker_lock);
+
+    pthread_mutex_lock(&parse_worker_dispatch_lock);
+    pthread_cond_broadcast(&parse_worker_dispatch_turn);
+    pthread_mutex_unlock(&parse_worker_dispatch_lock);
+}
+
+//return NULL when the worker has to stop
+static ParseWorkerJob* parse_worker_pop(void) {
+    ParseWorkerJob *job = NULL;
+
+    pthread_mutex_lock(&parse_worker_lock);
+    while(!atomic_load(&parse_worker_end) && (job = (ParseWorkerJob*)g_queue_pop_head(parse_worker_jobs))==NULL) {
+        pthread_cond_wait(&parse_worker_wakeup, &parse_worker_lock);
+    }
+    pthread_mutex_unlock(&parse_worker_lock);
+
+    return job;
+}
+
+static void parse_worker_process(ParseWorkerJob *job) {
+    ChannelRequest request;
+    bool comm_awake = false, subscribe_awake = false, parsed;
+
+    //payload parsing runs concurrently, only the dispatch keeps the channel acknowledgement order
+    request.trace = job->trace;
+    parsed = channel_request_parse(cJSON_ParseWithLength(job->text, job->length), &request);
+    if(!parsed) {
+        proxy_log("ERROR", "proxy %s parse worker fails to parse request %s payload", proxy_name, job->rid);
+    }
+
+    pthread_mutex_lock(&parse_worker_dispatch_lock);
+    while(!atomic_load(&parse_worker_end) && job->ticket!=parse_worker_dispatch_ticket) {
+        pthread_cond_wait(&parse_worker_dispatch_turn, &parse_worker_dispatch_lock);
+    }
+    if(!atomic_load(&parse_worker_end)) {
+        if(parsed) {
+            channel_request_dispatch(job->rid, &request, &comm_awake, &subscribe_awake);
+        } else {
+            reply_queue_append_invalid_status(job->rid, PROXYSERVICESTATUS_PAYLOAD_INVALID);
+            subscribe_awake = true;
+        }
+    }
+    parse_worker_dispatch_ticket++;
+    pthread_cond_broadcast(&parse_worker_dispatch_turn);
+    pthread_mutex_unlock(&parse_worker_dispatch_lock);
+
+    channel_request_clear(&request);
+
+    if(comm_awake) {
+        proxy_comm_awake();
+    }
+    if(subscribe_awake) {
+        proxy_subscribe_awake();
+    }
+}
+
+static void parse_worker_job_destroy(ParseWorkerJob *job) {
+    if(job!=NULL) {
+        free(job->text);
+        free(job);
+    }
+}
\ No newline at end of file
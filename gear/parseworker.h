@@ -0,0 +1,19 @@
+#ifndef _PARSEWORKER_H_
+#define _PARSEWORKER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "confvar.h"
+#include "trace.h"
+
+extern void parse_worker_context_init(const ConfVar *cv_head);
+extern void parse_worker_context_destroy(void);
+extern unsigned int parse_worker_count(void);
+extern void parse_worker_submit(const char *rid, char *text, size_t length, const TraceContext *trace);//take over text
+extern void* parse_worker(void *arg);//arg is the worker index
+extern void parse_worker_waitfor_started(unsigned int worker_index);
+extern bool parse_worker_isstarted(unsigned int worker_index);
+extern void parse_worker_stop(void);
+
+#endif //_PARSEWORKER_H_
\ No newline at end of file
@@ -0,0 +1,152 @@
+#include <sys/mman.h>
+#include <sys/stat.h>        /* For mode constants */
+#include <fcntl.h>           /* For O_* constants */
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include "define.h"
+#include "log.h"
+#include "payloadring.h"
+
+#define PAYLOADRING_ALIGN 8
+
+static size_t payload_ring_align(size_t length);
+
+ProxyRingShm* payload_ring_create(const char *path, size_t capacity) {
+    int fd;
+    char buff[PROXYLOGBUFLEN];
+    ProxyRingShm *ring;
+    size_t map_length;
+
+    capacity = payload_ring_align(capacity);
+    map_length = sizeof(ProxyRingShm) + capacity;
+
+    fd = shm_open(path, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+    if(fd==-1) {
+        strerror_r(errno, buff, PROXYLOGBUFLEN);
+        proxy_log("ERROR", "shm %s creation failed, %s", path, buff);
+        return NULL;
+    }
+    if(ftruncate(fd, map_length)==-1) {
+        strerror_r(errno, buff, PROXYLOGBUFLEN);
+        proxy_log("ERROR", "shm %s resize failed, %s", path, buff);
+        close(fd);
+        return NULL;
+    }
+
+    //MAP_POPULATE pre-faults the whole ring once so requests never page fault
+    ring = (ProxyRingShm*)mmap(NULL, map_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+    if(ring==MAP_FAILED) {
+        strerror_r(errno, buff, PROXYLOGBUFLEN);
+        proxy_log("ERROR", "shm %s map failed, %s", path, buff);
+        return NULL;
+    }
+
+    ring->capacity = capacity;
+    payload_ring_reset(ring);
+
+    return ring;
+}
+
+void payload_ring_destroy(ProxyRingShm *ring, const char *path, bool unlink) {
+    if(ring!=NULL) {
+        munmap(ring, sizeof(ProxyRingShm) + ring->capacity);
+    }
+    if(path!=NULL && unlink) {
+        shm_unlink(path);
+    }
+}
+
+bool payload_ring_reserve(ProxyRingShm *ring, size_t length, ProxyRingSlot *slot) {
+    size_t aligned, offset, waste;
+
+    aligned = payload_ring_align(length);
+    if(aligned<1 || aligned>ring->capacity) {
+        return false;
+    }
+
+    if(ring->used==0) {
+        ring->head = ring->tail = 0;
+    }
+
+    waste = 0;
+    if(ring->used>0 && ring->head==ring->tail) {//full
+        return false;
+    } else if(ring->head>=ring->tail) {
+        if(ring->capacity - ring->head >= aligned) {
+            offset = ring->head;
+        } else if(ring->tail >= aligned) {//wrap, the end of the ring is wasted until released
+            waste = ring->capacity - ring->head;
+            offset = 0;
+        } else {
+            return false;
+        }
+    } else if(ring->tail - ring->head >= aligned) {
+        offset = ring->head;
+    } else {
+        return false;
+    }
+
+    ring->used += waste + aligned;
+    ring->head = offset + aligned;
+    if(ring->head==ring->capacity) {
+        ring->head = 0;
+    }
+
+    slot->sequence = ++ring->reserved_sequence;
+    if(slot->sequence==0) {//0 is reserved for no slot
+        slot->sequence = ++ring->reserved_sequence;
+    }
+    slot->offset = offset;
+    slot->length = length;
+    return true;
+}
+
+char* payload_ring_slot_data(ProxyRingShm *ring, const ProxyRingSlot *slot) {
+    if(slot->sequence==0 || slot->length<1 || slot->offset>=ring->capacity
+        || slot->length > ring->capacity - slot->offset)
+    {
+        return NULL;
+    }
+    return (char*)(ring + 1) + slot->offset;
+}
+
+void payload_ring_release(ProxyRingShm *ring, const ProxyRingSlot *slot) {
+    size_t aligned, waste;
+    unsigned long expected;
+
+    expected = ring->released_sequence + 1;
+    if(expected==0) {
+        expected = 1;
+    }
+    aligned = payload_ring_align(slot->length);
+    waste = slot->offset!=ring->tail ? ring->capacity - ring->tail : 0;//producer wrapped, the end of the ring was wasted
+    if(slot->sequence!=expected || ring->used < waste + aligned) {
+        proxy_log("ERROR", "payload ring release of sequence %lu is out of order, ring is reset", slot->sequence);
+        payload_ring_reset(ring);
+        return;
+    }
+
+    ring->used -= waste + aligned;
+    ring->tail = slot->offset + aligned;
+    if(ring->tail==ring->capacity) {
+        ring->tail = 0;
+    }
+    ring->released_sequence = slot->sequence;
+    if(ring->used==0) {
+        ring->head = ring->tail = 0;
+    }
+}
+
+void payload_ring_reset(ProxyRingShm *ring) {
+    ring->head = 0;
+    ring->tail = 0;
+    ring->used = 0;
+    ring->released_sequence = ring->reserved_sequence;
+}
+
+static size_t payload_ring_align(size_t length) {
+    return (length + PAYLOADRING_ALIGN - 1) & ~((size_t)PAYLOADRING_ALIGN - 1);
+}
@@ -0,0 +1,17 @@
+#ifndef _PAYLOADRING_H_
+#define _PAYLOADRING_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "proxy.h"
+
+//ring header is guarded by the lock of the shm owning the handshake (channel or subscribe)
+extern ProxyRingShm* payload_ring_create(const char *path, size_t capacity);
+extern void payload_ring_destroy(ProxyRingShm *ring, const char *path, bool unlink);
+extern bool payload_ring_reserve(ProxyRingShm *ring, size_t length, ProxyRingSlot *slot);//return false when ring is full
+extern char* payload_ring_slot_data(ProxyRingShm *ring, const ProxyRingSlot *slot);//return NULL on invalid slot
+extern void payload_ring_release(ProxyRingShm *ring, const ProxyRingSlot *slot);
+extern void payload_ring_reset(ProxyRingShm *ring);
+
+#endif //_PAYLOADRING_H_
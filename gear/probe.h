@@ -0,0 +1,27 @@
+#ifndef _PROBE_H_
+#define _PROBE_H_
+
+//USDT probes of provider sawang, compiled in with ./configure --enable-usdt, list them with
+//bpftrace -l 'usdt:/usr/local/lib/libsawang.so:sawang:*'
+//
+//channel__read(rid, payload length)
+//channel__dispatch(rid, service, parse result)
+//parse__queue__push(service, queue depth)
+//comm__pop(service, queue depth)
+//comm__run__start(service), comm__run__done()
+//comm__reply(service, subscribers, multirespond)
+//reply__queue__push(rid json, answer buffer length, queue depth)
+//subscribe__exchange__start(answers, frame length), subscribe__exchange__done(state)
+//respond__table__set(table, rid, new entry), respond__table__drop(table, rid, dropped)
+//respond__table__drop__requests(table, rid count, emptied tasks)
+//
+//queue depths are kept by the queues themselves, also when metrics is disabled
+
+#ifdef USDT
+#include <sys/sdt.h>
+#define SAWANG_PROBE(...) STAP_PROBEV(sawang, __VA_ARGS__)
+#else
+#define SAWANG_PROBE(...) do{}while(0)//arguments are not evaluated
+#endif
+
+#endif //_PROBE_H_
\ No newline at end of file
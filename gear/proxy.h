@@ -2,12 +2,27 @@
 #define _PROXY_H_
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
 #include <pthread.h>
 #include <glib.h>
 
 #include "define.h"
 #include "callback.h"
 
+/*ProxyWakeupBackend should be the same as gonggo, the side creating a segment picks it and the other side follows*/
+enum ProxyWakeupBackend {
+    WAKEUP_CONDVAR = 0, //the pthread_cond_t of the segment
+    WAKEUP_FUTEX = 1, //futex on ProxyWakeupWord.sequence
+    WAKEUP_SPIN = 2 //spin on ProxyWakeupWord.sequence before sleeping on the futex
+};
+
+/*ProxyWakeupWord should be the same as gonggo*/
+typedef struct ProxyWakeupWord {
+    _Atomic uint32_t sequence; //bumped by every signal
+    _Atomic uint32_t parked; //waiters asleep in the kernel, a signal issues no syscall without them
+} ProxyWakeupWord;
+
 /*ProxyActivationState should be the same as proxy*/
 enum ProxyActivationState {
   ACTIVATION_INIT = 0,
@@ -29,8 +44,30 @@ typedef struct ProxyActivationShm {
     char proxy_name[PROXYNAMEBUFLEN];
     pid_t pid;
     enum ProxyActivationState state;
+////WAKEUP:
+    enum ProxyWakeupBackend wakeup; //set by gonggo, a segment of an older gonggo ends before it and is WAKEUP_CONDVAR
+    unsigned int wakeup_spin; //spin rounds of WAKEUP_SPIN
+    ProxyWakeupWord dispatcher_word;
+    ProxyWakeupWord proxy_word;
 } ProxyActivationShm;
 
+/*ProxyRingSlot should be the same as gonggo*/
+typedef struct ProxyRingSlot {
+    unsigned long sequence; //0 when the slot does not point into a ring
+    size_t offset;
+    size_t length;
+} ProxyRingSlot;
+
+/*ProxyRingShm should be the same as gonggo, the ring data region follows the header*/
+typedef struct ProxyRingShm {
+    size_t capacity;
+    size_t head;
+    size_t tail;
+    size_t used;
+    unsigned long reserved_sequence;
+    unsigned long released_sequence;
+} ProxyRingShm;
+
 /*ProxyChannelState should be the same as proxy*/
 enum ProxyChannelState {
     CHANNEL_INIT = 0,
@@ -40,11 +77,21 @@ enum ProxyChannelState {
     CHANNEL_FAILS = 4,
     CHANNEL_DONE = 5,
     CHANNEL_STOP_REQUEST = 6,
+    CHANNEL_REQUEST_BATCH = 7,
     CHANNEL_REST = 10,
     CHANNEL_REST_RESPOND = 11,
     CHANNEL_TERMINATION = 99
 };
 
+/*ProxyRequestRecord should be the same as gonggo*/
+#define CHANNEL_BATCH_MAX 64
+typedef struct ProxyRequestRecord {
+    char rid[UUIDBUFLEN]; //request id
+    size_t payload_buff_length;
+    ProxyRingSlot payload_slot; //payload_slot.sequence 0 means payload is in the rid shm
+    bool failed; //set by proxy when the payload can not be read
+} ProxyRequestRecord;
+
 /*ProxyChannelShm should be the same as proxy*/
 typedef struct ProxyChannelShm {
     pthread_mutex_t lock;
@@ -57,6 +104,24 @@ typedef struct ProxyChannelShm {
 ////REST:
     char aid[UUIDBUFLEN]; //rest answer id
     size_t answer_buff_length;
+////RING:
+    size_t ring_capacity; //0 when the payload ring is disabled
+    ProxyRingSlot payload_slot; //payload_slot.sequence 0 means payload is in the rid shm
+    ProxyRingSlot answer_slot; //answer_slot.sequence 0 means REST answer is in the aid shm
+////BATCH:
+    unsigned int request_count; //number of requests for CHANNEL_REQUEST_BATCH
+    ProxyRequestRecord requests[CHANNEL_BATCH_MAX];
+////LANE:
+    unsigned int lane; //lane 0 is /<proxy>_channel, lane i is /<proxy>_channel_<i>
+    unsigned int lane_count;
+////REST:
+    unsigned int rest_lane_count; //REST lanes /<proxy>_rest_<i>, 0 when REST is served by the channel lanes
+////WAKEUP:
+    enum ProxyWakeupBackend wakeup; //set by proxy, gonggo waits and signals the same way
+    unsigned int wakeup_spin; //spin rounds of WAKEUP_SPIN
+    ProxyWakeupWord dispatcher_word;
+    ProxyWakeupWord proxy_word;
+    ProxyWakeupWord idle_word;
 } ProxyChannelShm;
 
 enum ProxySubscribeState {
@@ -68,6 +133,15 @@ enum ProxySubscribeState {
     SUBSCRIBE_TERMINATION = 99
 };
 
+/*ProxyAnswerRecord should be the same as gonggo,
+ *a batched answer is answer_count records, each record header is followed by its answer text
+ *and padded to ANSWER_RECORD_ALIGN bytes*/
+#define ANSWER_RECORD_ALIGN 8
+typedef struct ProxyAnswerRecord {
+    size_t length; //answer text length including string terminator
+    bool remove_request;
+} ProxyAnswerRecord;
+
 /*ProxySubscribeShm should be the same as gonggo*/
 typedef struct ProxySubscribeShm {
     pthread_mutex_t lock;
@@ -77,6 +151,16 @@ typedef struct ProxySubscribeShm {
     char aid[UUIDBUFLEN]; //answer id
     size_t payload_buff_length;
     bool remove_request;
+////RING:
+    size_t ring_capacity; //0 when the answer ring is disabled
+    ProxyRingSlot answer_slot; //answer_slot.sequence 0 means answer is in the aid shm
+////BATCH:
+    unsigned int answer_count; //0 for a single answer text, otherwise number of ProxyAnswerRecord
+////WAKEUP:
+    enum ProxyWakeupBackend wakeup; //set by proxy, gonggo waits and signals the same way
+    unsigned int wakeup_spin; //spin rounds of WAKEUP_SPIN
+    ProxyWakeupWord dispatcher_word;
+    ProxyWakeupWord proxy_word;
 } ProxySubscribeShm;
 
 #endif //_PROXY_H_
\ No newline at end of file
@@ -12,12 +12,21 @@
 #include "log.h"
 #include "proxy.h"
 #include "globaldata.h"
+#include "wakeup.h"
+#include "proxychannel.h"
+#include "proxysubscribe.h"
 
 #define ACTIVATION_IDLE_TTL 5
 #define ACTIVATION_IDLE_TIMEOUT_SEC 5
 #define ACTIVATION_REQUEST_RESPOND_TIMEOUT_SEC 10
 
+//property
+static Wakeup proxy_activation_dispatcher_wakeup;
+static Wakeup proxy_activation_proxy_wakeup;
+
+//function
 static ProxyActivationShm* proxy_activation_get_map(bool activation);
+static bool proxy_activation_wakeup_bind(ProxyActivationShm *map, off_t size);//return false for an older gonggo
 
 bool proxy_activate(void) {    
     ProxyActivationShm *shm = NULL;
@@ -39,7 +48,7 @@ bool proxy_activate(void) {
     strcpy(shm->proxy_name, proxy_name);
     shm->pid = getpid();
     shm->state = ACTIVATION_REQUEST;
-    pthread_cond_signal(&shm->dispatcher_wakeup);
+    wakeup_signal(&proxy_activation_dispatcher_wakeup);
     pthread_mutex_unlock(&shm->lock);
     usleep(1000);
 
@@ -53,7 +62,7 @@ bool proxy_activate(void) {
     if(shm->state == ACTIVATION_REQUEST) {//if still unchanged then wait
         clock_gettime(CLOCK_REALTIME, &ts);
         ts.tv_sec += ACTIVATION_REQUEST_RESPOND_TIMEOUT_SEC; //wait n seconds from now
-        if( pthread_cond_timedwait( &shm->proxy_wakeup, &shm->lock, &ts )==EOWNERDEAD ) {
+        if( wakeup_timedwait(&proxy_activation_proxy_wakeup, &ts)==EOWNERDEAD ) {
             proxy_log("ERROR", "%s is out of service for proxy %s activation, ACTIVATION_REQUEST is not answered", gonggo_name, proxy_name);
             munmap(shm, sizeof(ProxyActivationShm));
             return false;
@@ -79,7 +88,7 @@ bool proxy_activate(void) {
     proxy_log("INFO", "%s answers proxy %s ACTIVATION_REQUEST with ACTIVATION_SUCCESS", gonggo_name, proxy_name);
     proxy_log("INFO", "%s sends ACTIVATION_DONE to %s", proxy_name, gonggo_name);
     shm->state = ACTIVATION_DONE;
-    pthread_cond_signal(&shm->dispatcher_wakeup);
+    wakeup_signal(&proxy_activation_dispatcher_wakeup);
     pthread_mutex_unlock(&shm->lock);
 
     munmap(shm, sizeof(ProxyActivationShm));
@@ -93,6 +102,7 @@ static ProxyActivationShm* proxy_activation_get_map(bool activation) {
     int fd, status;
     const char *sact = activation ? "activation" : "deactivation";
     struct timespec ts;
+    struct stat st;
 
     gonggo_path = (char*)malloc(strlen(gonggo_name) + 2);
     sprintf(gonggo_path, "/%s", gonggo_name);
@@ -115,7 +125,15 @@ static ProxyActivationShm* proxy_activation_get_map(bool activation) {
     }
 
     free(gonggo_path);
+    if(fstat(fd, &st)==-1) {
+        st.st_size = 0;
+    }
     close(fd);
+    if(!proxy_activation_wakeup_bind(map, st.st_size) && activation) {
+        //before ACTIVATION_REQUEST, gonggo does not touch the proxy segments yet
+        proxy_channel_wakeup_condvar();
+        proxy_subscribe_wakeup_condvar();
+    }
 
     if(pthread_mutex_lock(&map->lock)==EOWNERDEAD) {
         proxy_log("ERROR", "%s is out of service for proxy %s %s", gonggo_name, proxy_name, sact);
@@ -129,7 +147,7 @@ static ProxyActivationShm* proxy_activation_get_map(bool activation) {
     ////put in loop for racing with other proxies
         clock_gettime(CLOCK_REALTIME, &ts);
         ts.tv_sec += ACTIVATION_IDLE_TIMEOUT_SEC; //wait n seconds from now
-        status = pthread_cond_timedwait( &map->proxy_wakeup, &map->lock, &ts);
+        status = wakeup_timedwait(&proxy_activation_proxy_wakeup, &ts);
         if(status==EOWNERDEAD) {
             proxy_log("ERROR", "%s is out of service for proxy %s %s", gonggo_name, proxy_name, sact);
             munmap(map, sizeof(ProxyActivationShm));
@@ -153,4 +171,20 @@ static ProxyActivationShm* proxy_activation_get_map(bool activation) {
     return map;
 }
 
-
+//gonggo creates the segment and picks the backend, a segment too short for the wakeup fields is WAKEUP_CONDVAR
+static bool proxy_activation_wakeup_bind(ProxyActivationShm *map, off_t size) {
+    enum ProxyWakeupBackend backend;
+    unsigned int spin;
+    bool fields;
+
+    backend = WAKEUP_CONDVAR;
+    spin = 0;
+    fields = size>=(off_t)sizeof(ProxyActivationShm);
+    if(fields && (map->wakeup==WAKEUP_FUTEX || map->wakeup==WAKEUP_SPIN)) {
+        backend = map->wakeup;
+        spin = map->wakeup_spin;
+    }
+    wakeup_bind(&proxy_activation_dispatcher_wakeup, backend, spin, &map->lock, &map->dispatcher_wakeup, &map->dispatcher_word);
+    wakeup_bind(&proxy_activation_proxy_wakeup, backend, spin, &map->lock, &map->proxy_wakeup, &map->proxy_word);
+    return fields;
+}
\ No newline at end of file
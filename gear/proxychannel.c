@@ -7,10 +7,11 @@
 #include <string.h>
 #include <errno.h>
 #include <signal.h>
+#include <stdint.h>
 
 #include "log.h"
 #include "proxy.h"
-#include "util.h"
+#include "wakeup.h"
 #include "globaldata.h"
 #include "cJSON.h"
 #include "callback.h"
@@ -21,37 +22,113 @@
 #include "parsequeue.h"
 #include "proxyservicestatus.h"
 #include "proxyuuid.h"
+#include "payloadring.h"
+#include "channelrequest.h"
+#include "parseworker.h"
+#include "proxychannel.h"
+#include "metrics.h"
+#include "trace.h"
+#include "probe.h"
 
 #define CHANNEL_SUFFIX "_channel"
+#define CHANNEL_RING_SUFFIX "_ring"
+#define CHANNEL_REST_SUFFIX "_rest"
+#define CHANNEL_LANES_MAX 64
+
+typedef struct ProxyChannelLane {
+    unsigned int index;
+    bool rest;//REST lane, serves CHANNEL_REST only
+    char *path;
+    ProxyChannelShm *shm;
+    char *ring_path;
+    ProxyRingShm *ring;
+    Wakeup dispatcher_wakeup;
+    Wakeup proxy_wakeup;
+    Wakeup idle;
+    volatile bool started;
+} ProxyChannelLane;
 
 //property
-static char *proxy_channel_path = NULL;
-static volatile bool proxy_channel_started = false;
+static ProxyChannelLane *proxy_channel_lanes = NULL;
+static unsigned int proxy_channel_lane_total = 0;
 static bool proxy_channel_end = false;
 static bool proxy_channel_shm_unlink = false;
-static ProxyChannelShm *proxy_channel_shm = NULL;
-static ProxyPayloadParse proxy_channel_payload_parse = NULL;
+static const ConfVar *proxy_channel_cv_head = NULL;
 static ProxyRest proxy_rest = NULL;
+static enum ProxyWakeupBackend proxy_channel_wakeup = WAKEUP_CONDVAR;
+static unsigned int proxy_channel_wakeup_spin = WAKEUP_SPIN_DEFAULT;
 
 //function
-static char* proxy_channel_path_create(void);
-static bool proxy_channel_shm_create(const char *proxy_path);
-static void proxy_channel_shm_idle(void);
-static bool proxy_channel_exchange(void);
-static bool proxy_channel_rest(const ConfVar *cv_head);
+static char* proxy_channel_path_create(const ProxyChannelLane *lane, const char *suffix);
+static bool proxy_channel_shm_create(ProxyChannelLane *lane);
+static bool proxy_channel_ring_create(ProxyChannelLane *lane, long capacity);
+static void proxy_channel_lane_destroy(ProxyChannelLane *lane);
+static void proxy_channel_wakeup_bind(ProxyChannelLane *lane, enum ProxyWakeupBackend backend, unsigned int spin);
+static void proxy_channel_shm_idle(ProxyChannelLane *lane);
+static bool proxy_channel_exchange(ProxyChannelLane *lane);
+static bool proxy_channel_exchange_batch(ProxyChannelLane *lane);
+static bool proxy_channel_exchange_deferred(ProxyChannelLane *lane, bool batch);
+static unsigned int proxy_channel_batch_count(ProxyChannelLane *lane);
+static bool proxy_channel_waitfor_done(ProxyChannelLane *lane);
+static bool proxy_channel_refuse(ProxyChannelLane *lane);
+static bool proxy_channel_request_read(ProxyChannelLane *lane, const char *rid, size_t buff_length, const ProxyRingSlot *slot, ChannelRequest *request);
+static bool proxy_channel_rest(ProxyChannelLane *lane, const ConfVar *cv_head);
+static cJSON* proxy_channel_payload_read(ProxyChannelLane *lane, const char *rid, size_t buff_length, const ProxyRingSlot *slot);
+static cJSON* proxy_channel_payload_ring_read(ProxyChannelLane *lane, const ProxyRingSlot *slot);
+static char* proxy_channel_payload_ring_data(ProxyChannelLane *lane, const ProxyRingSlot *slot);
 static cJSON* proxy_channel_payload_shm_read(const char *rid, size_t buff_length);
+static char* proxy_channel_payload_dup(ProxyChannelLane *lane, const char *rid, size_t buff_length, const ProxyRingSlot *slot, size_t *length);
+static char* proxy_channel_payload_shm_map(const char *rid, size_t buff_length);
 static char* proxy_channel_respond_create(int code, const char* err, cJSON *json);
 static size_t proxy_rest_create_answer(const char *path, const char *respond);
+static bool proxy_rest_answer_ring_write(ProxyChannelLane *lane, const char *respond);
 
-bool proxy_channel_context_init(ProxyPayloadParse f_payload_parse, ProxyRest f_rest) 
+bool proxy_channel_context_init(const ConfVar *cv_head, ProxyPayloadParse f_payload_parse, ProxyRest f_rest) 
 {
-    proxy_channel_path = proxy_channel_path_create();
-    if(!proxy_channel_shm_create(proxy_channel_path)) {
-        free(proxy_channel_path);
-        proxy_channel_path = NULL;
-        return false;
+    unsigned int i, lanes, rest_lanes;
+    long ring_capacity;
+
+    if(!confvar_uint(cv_head, CONF_CHANNEL_LANES, &lanes) || lanes<1) {
+        lanes = 1;
+    } else if(lanes>CHANNEL_LANES_MAX) {
+        proxy_log("ERROR", "proxy %s %s %u is capped to %d", proxy_name, CONF_CHANNEL_LANES, lanes, CHANNEL_LANES_MAX);
+        lanes = CHANNEL_LANES_MAX;
+    }
+    if(!confvar_uint(cv_head, CONF_REST_LANES, &rest_lanes)) {
+        rest_lanes = 0;//REST is served by the channel lanes
+    } else if(rest_lanes>CHANNEL_LANES_MAX) {
+        proxy_log("ERROR", "proxy %s %s %u is capped to %d", proxy_name, CONF_REST_LANES, rest_lanes, CHANNEL_LANES_MAX);
+        rest_lanes = CHANNEL_LANES_MAX;
+    }
+    if(!confvar_long(cv_head, CONF_CHANNEL_RING, &ring_capacity)) {
+        ring_capacity = 0;//ring is optional, payload is read from the rid shm
+    }
+    if(!wakeup_backend_parse(confvar_value(cv_head, CONF_WAKEUP), &proxy_channel_wakeup)) {
+        proxy_log("ERROR", "proxy %s %s %s is unknown, condvar is used", proxy_name, CONF_WAKEUP, confvar_value(cv_head, CONF_WAKEUP));
+        proxy_channel_wakeup = WAKEUP_CONDVAR;
+    }
+    if(!confvar_uint(cv_head, CONF_WAKEUP_SPIN, &proxy_channel_wakeup_spin)) {
+        proxy_channel_wakeup_spin = WAKEUP_SPIN_DEFAULT;
+    }
+
+    //REST lanes follow the channel lanes
+    proxy_channel_lanes = (ProxyChannelLane*)calloc(lanes + rest_lanes, sizeof(ProxyChannelLane));
+    proxy_channel_lane_total = lanes + rest_lanes;
+    for(i=0; i<proxy_channel_lane_total; i++) {
+        proxy_channel_lanes[i].rest = i>=lanes;
+        proxy_channel_lanes[i].index = i>=lanes ? i - lanes : i;
+        if(!proxy_channel_shm_create(&proxy_channel_lanes[i]) 
+            || (ring_capacity>0 && !proxy_channel_ring_create(&proxy_channel_lanes[i], ring_capacity))) 
+        {
+            proxy_channel_shm_unlink_enable();
+            proxy_channel_context_destroy();
+            return false;
+        }
+        proxy_channel_lanes[i].shm->lane_count = lanes;
+        proxy_channel_lanes[i].shm->rest_lane_count = rest_lanes;
     }
-    proxy_channel_payload_parse = f_payload_parse;
+    proxy_channel_cv_head = cv_head;
+    channel_request_context_init(cv_head, f_payload_parse);
     proxy_rest = f_rest;
     return true;
 }
@@ -61,305 +138,421 @@ void proxy_channel_shm_unlink_enable(void) {
 }
 
 void proxy_channel_context_destroy(void) {
-    if(proxy_channel_shm!=NULL) {
-        if(proxy_channel_shm_unlink) {
-            pthread_mutex_destroy(&proxy_channel_shm->lock);
+    unsigned int i;
 
-            proxy_cond_reset(&proxy_channel_shm->dispatcher_wakeup);
-            pthread_cond_destroy(&proxy_channel_shm->dispatcher_wakeup);
+    if(proxy_channel_lanes!=NULL) {
+        for(i=0; i<proxy_channel_lane_total; i++) {
+            proxy_channel_lane_destroy(&proxy_channel_lanes[i]);
+        }
+        free(proxy_channel_lanes);
+        proxy_channel_lanes = NULL;
+        proxy_channel_lane_total = 0;
+    }
+    channel_request_context_destroy();
+}
 
-            proxy_cond_reset(&proxy_channel_shm->proxy_wakeup);
-            pthread_cond_destroy(&proxy_channel_shm->proxy_wakeup);
+//an older gonggo only signals the condition variables, the lane threads already asleep on the word are woken to wait again on them
+void proxy_channel_wakeup_condvar(void) {
+    ProxyChannelLane *lane;
+    unsigned int i;
 
-            proxy_cond_reset(&proxy_channel_shm->idle);
-            pthread_cond_destroy(&proxy_channel_shm->idle);
-        }
-        munmap(proxy_channel_shm, sizeof(ProxyChannelShm));
-        proxy_channel_shm = NULL;   
+    if(proxy_channel_wakeup==WAKEUP_CONDVAR) {
+        return;
     }
-    if(proxy_channel_path!=NULL) {
-        if(proxy_channel_shm_unlink) {
-            shm_unlink(proxy_channel_path);
+    for(i=0; i<proxy_channel_lane_total; i++) {
+        lane = &proxy_channel_lanes[i];
+        if(lane->shm==NULL) {
+            continue;
+        }
+        if(pthread_mutex_lock(&lane->shm->lock)==EOWNERDEAD) {
+            pthread_mutex_consistent(&lane->shm->lock);
         }
-        free(proxy_channel_path);
-        proxy_channel_path = NULL;
+        wakeup_broadcast(&lane->proxy_wakeup);
+        proxy_channel_wakeup_bind(lane, WAKEUP_CONDVAR, 0);
+        pthread_mutex_unlock(&lane->shm->lock);
     }
+    proxy_log("INFO", "proxy %s channel falls back from %s to condvar wakeup for %s", proxy_name, wakeup_backend_name(proxy_channel_wakeup), gonggo_name);
+    proxy_channel_wakeup = WAKEUP_CONDVAR;
+}
+
+unsigned int proxy_channel_lane_count(void) {
+    return proxy_channel_lane_total;
 }
 
 void* proxy_channel(void *arg) {
-    const ConfVar *cv_head;
+    ProxyChannelLane *lane;
+    const char *kind;
 
-    cv_head = (const ConfVar *)arg;
+    lane = &proxy_channel_lanes[(uintptr_t)arg];
+    kind = lane->rest ? "rest" : "channel";
 
-    proxy_log("INFO", "proxy %s channel thread is started", proxy_name);
+    proxy_log("INFO", "proxy %s %s %u thread is started", proxy_name, kind, lane->index);
 
-    if(pthread_mutex_lock(&proxy_channel_shm->lock) == EOWNERDEAD) {
-        pthread_mutex_consistent(&proxy_channel_shm->lock);//resurrection
+    if(pthread_mutex_lock(&lane->shm->lock) == EOWNERDEAD) {
+        pthread_mutex_consistent(&lane->shm->lock);//resurrection
     }
 
-    proxy_channel_started = true;
+    lane->started = true;
 
     while(!proxy_channel_end) {
-        proxy_channel_shm_idle();//set state to CHANNEL_IDLE
-        pthread_cond_signal(&proxy_channel_shm->idle);
+        proxy_channel_shm_idle(lane);//set state to CHANNEL_IDLE
+        wakeup_signal(&lane->idle);
 
-        if(pthread_cond_wait(&proxy_channel_shm->proxy_wakeup, &proxy_channel_shm->lock)==EOWNERDEAD) {
-            pthread_mutex_consistent(&proxy_channel_shm->lock);
-            proxy_log("INFO", "proxy %s channel waits wakeup with inconsistent mutex indicating gonggo dead", proxy_name);
+        if(wakeup_wait(&lane->proxy_wakeup)==EOWNERDEAD) {
+            pthread_mutex_consistent(&lane->shm->lock);
+            proxy_log("INFO", "proxy %s %s %u waits wakeup with inconsistent mutex indicating gonggo dead", proxy_name, kind, lane->index);
             break;
-        } else if(proxy_channel_shm->state == CHANNEL_TERMINATION) {
-            proxy_log("INFO", "proxy %s channel waits wakeup with CHANNEL_TERMINATION", proxy_name);
+        } else if(lane->shm->state == CHANNEL_TERMINATION) {
+            proxy_log("INFO", "proxy %s %s %u waits wakeup with CHANNEL_TERMINATION", proxy_name, kind, lane->index);
             break;
-        } else if(proxy_channel_shm->state==CHANNEL_STOP_REQUEST) {
-            proxy_log("INFO", "proxy %s channel receive CHANNEL_STOP_REQUEST", proxy_name);
+        } else if(lane->shm->state==CHANNEL_STOP_REQUEST) {
+            proxy_log("INFO", "proxy %s %s %u receive CHANNEL_STOP_REQUEST", proxy_name, kind, lane->index);
             proxy_exit = true;
             kill(getpid(), SIGTERM);
-        } else if (proxy_channel_shm->state==CHANNEL_REQUEST) {
-            proxy_log("INFO", "proxy %s channel receive CHANNEL_REQUEST", proxy_name);
-            if(!proxy_channel_exchange()){
+        } else if (lane->rest && (lane->shm->state==CHANNEL_REQUEST || lane->shm->state==CHANNEL_REQUEST_BATCH)) {
+            proxy_log("ERROR", "proxy %s rest %u refuses client request state %ld", proxy_name, lane->index, lane->shm->state);
+            if(!proxy_channel_refuse(lane)){
                 break;
             }
-        } else if (proxy_channel_shm->state==CHANNEL_REST) {
-            proxy_log("INFO", "proxy %s channel receive CHANNEL_REST", proxy_name);
-            if(!proxy_channel_rest(cv_head)) {
+        } else if (lane->shm->state==CHANNEL_REQUEST) {
+            proxy_log("INFO", "proxy %s %s %u receive CHANNEL_REQUEST", proxy_name, kind, lane->index);
+            if(!proxy_channel_exchange(lane)){
+                break;
+            }
+        } else if (lane->shm->state==CHANNEL_REQUEST_BATCH) {
+            proxy_log("INFO", "proxy %s %s %u receive CHANNEL_REQUEST_BATCH of %u", proxy_name, kind, lane->index, lane->shm->request_count);
+            if(!proxy_channel_exchange_batch(lane)){
+                break;
+            }
+        } else if (lane->shm->state==CHANNEL_REST) {
+            proxy_log("INFO", "proxy %s %s %u receive CHANNEL_REST", proxy_name, kind, lane->index);
+            if(!proxy_channel_rest(lane, proxy_channel_cv_head)) {
                 break;
             }
         }
     }
 
-    pthread_mutex_unlock(&proxy_channel_shm->lock);
+    pthread_mutex_unlock(&lane->shm->lock);
 
-    proxy_log("INFO", "proxy %s channel thread is stopped", proxy_name);
+    proxy_log("INFO", "proxy %s %s %u thread is stopped", proxy_name, kind, lane->index);
     pthread_exit(NULL);
 }
 
-void proxy_channel_waitfor_started(void) {
-	while(!proxy_channel_started) {
+void proxy_channel_waitfor_started(unsigned int lane_index) {
+	while(!proxy_channel_lanes[lane_index].started) {
 		usleep(1000);
 	}
 }
 
-bool proxy_channel_isstarted(void) {
-    return proxy_channel_started;
+bool proxy_channel_isstarted(unsigned int lane_index) {
+    return proxy_channel_lanes!=NULL && lane_index<proxy_channel_lane_total && proxy_channel_lanes[lane_index].started;
 }
 
 void proxy_channel_stop(void) {
-    if(pthread_mutex_lock(&proxy_channel_shm->lock)==EOWNERDEAD) {
-        pthread_mutex_consistent(&proxy_channel_shm->lock);//resurrection
-    }
-    proxy_channel_shm->state = CHANNEL_TERMINATION;
+    unsigned int i;
+    ProxyChannelLane *lane;
+
     proxy_channel_end = true;
-    pthread_cond_signal(&proxy_channel_shm->proxy_wakeup);
-    pthread_mutex_unlock(&proxy_channel_shm->lock);
+    for(i=0; i<proxy_channel_lane_total; i++) {
+        lane = &proxy_channel_lanes[i];
+        if(pthread_mutex_lock(&lane->shm->lock)==EOWNERDEAD) {
+            pthread_mutex_consistent(&lane->shm->lock);//resurrection
+        }
+        lane->shm->state = CHANNEL_TERMINATION;
+        wakeup_signal(&lane->proxy_wakeup);
+        pthread_mutex_unlock(&lane->shm->lock);
+    }
 }
 
-static char* proxy_channel_path_create() {
+//lane 0 keeps the /<proxy>_channel name known by dispatchers without lanes, REST lane i is /<proxy>_rest_<i>
+static char* proxy_channel_path_create(const ProxyChannelLane *lane, const char *suffix) {
     char *shm_path;
 
-    shm_path = (char*)malloc(strlen(proxy_name) + strlen(CHANNEL_SUFFIX) + 2);
-    sprintf(shm_path, "/%s%s", proxy_name, CHANNEL_SUFFIX);
+    shm_path = (char*)malloc(strlen(proxy_name) + strlen(CHANNEL_SUFFIX) + strlen(suffix) + 14);
+    if(lane->rest) {
+        sprintf(shm_path, "/%s%s_%u%s", proxy_name, CHANNEL_REST_SUFFIX, lane->index, suffix);
+    } else if(lane->index==0) {
+        sprintf(shm_path, "/%s%s%s", proxy_name, CHANNEL_SUFFIX, suffix);
+    } else {
+        sprintf(shm_path, "/%s%s_%u%s", proxy_name, CHANNEL_SUFFIX, lane->index, suffix);
+    }
     return shm_path;
 }
 
-static bool proxy_channel_shm_create(const char *proxy_path) {
+static bool proxy_channel_shm_create(ProxyChannelLane *lane) {
     int fd;
     char buff[PROXYLOGBUFLEN];
     pthread_mutexattr_t mutexattr;
-    pthread_condattr_t condattr;
 
-    fd = shm_open(proxy_path, O_RDWR, S_IRUSR | S_IWUSR);
+    lane->path = proxy_channel_path_create(lane, "");
+    fd = shm_open(lane->path, O_RDWR, S_IRUSR | S_IWUSR);
     if( errno == ENOENT ) {
-        fd = shm_open(proxy_path, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+        fd = shm_open(lane->path, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
         if(fd>-1) {
             ftruncate(fd, sizeof(ProxyChannelShm)); //set size
         }
+    } else if(fd>-1) {
+        ftruncate(fd, sizeof(ProxyChannelShm)); //grow segment left by an older layout
     }
 
     if(fd==-1) {
         strerror_r(errno, buff, PROXYLOGBUFLEN);
-        proxy_log("ERROR", "shm %s creation failed, %s", proxy_path, buff);
+        proxy_log("ERROR", "shm %s creation failed, %s", lane->path, buff);
         return false;
     }
 
-    proxy_channel_shm = (ProxyChannelShm*)mmap(NULL, sizeof(ProxyChannelShm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    lane->shm = (ProxyChannelShm*)mmap(NULL, sizeof(ProxyChannelShm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
     close(fd);
+    if(lane->shm==MAP_FAILED) {
+        strerror_r(errno, buff, PROXYLOGBUFLEN);
+        proxy_log("ERROR", "shm %s map failed, %s", lane->path, buff);
+        lane->shm = NULL;
+        return false;
+    }
 
     pthread_mutexattr_init(&mutexattr);
     pthread_mutexattr_setpshared(&mutexattr, PTHREAD_PROCESS_SHARED);
     pthread_mutexattr_setrobust(&mutexattr, PTHREAD_MUTEX_ROBUST);
     pthread_mutexattr_settype(&mutexattr, PTHREAD_MUTEX_NORMAL);
-    if(pthread_mutex_init(&proxy_channel_shm->lock, &mutexattr) == EBUSY) {
-        if(pthread_mutex_consistent(&proxy_channel_shm->lock) == 0) {
-            pthread_mutex_unlock(&proxy_channel_shm->lock);
+    if(pthread_mutex_init(&lane->shm->lock, &mutexattr) == EBUSY) {
+        if(pthread_mutex_consistent(&lane->shm->lock) == 0) {
+            pthread_mutex_unlock(&lane->shm->lock);
         }
     }
     pthread_mutexattr_destroy(&mutexattr);//mutexattr is no longer needed
 
-    pthread_condattr_init(&condattr);
-    pthread_condattr_setpshared(&condattr, PTHREAD_PROCESS_SHARED);
-    pthread_cond_init(&proxy_channel_shm->dispatcher_wakeup, &condattr);
-    pthread_cond_init(&proxy_channel_shm->proxy_wakeup, &condattr);
-    pthread_cond_init(&proxy_channel_shm->idle, &condattr);
-    pthread_condattr_destroy(&condattr);//condattr is no longer needed
+    proxy_channel_wakeup_bind(lane, proxy_channel_wakeup, proxy_channel_wakeup_spin);
+    wakeup_init(&lane->dispatcher_wakeup);
+    wakeup_init(&lane->proxy_wakeup);
+    wakeup_init(&lane->idle);
+
+    lane->shm->state = CHANNEL_INIT;
+    lane->shm->rid[0] = 0;
+    lane->shm->payload_buff_length = 0;
+    lane->shm->ring_capacity = 0;
+    memset(&lane->shm->payload_slot, 0, sizeof(ProxyRingSlot));
+    memset(&lane->shm->answer_slot, 0, sizeof(ProxyRingSlot));
+    lane->shm->request_count = 0;
+    lane->shm->lane = lane->index;
+    lane->shm->lane_count = 1;
+    lane->shm->rest_lane_count = 0;
 
-    proxy_channel_shm->state = CHANNEL_INIT;
-    proxy_channel_shm->rid[0] = 0;
-    proxy_channel_shm->payload_buff_length = 0;
+    return true;
+}
+
+static bool proxy_channel_ring_create(ProxyChannelLane *lane, long capacity) {
+    lane->ring_path = proxy_channel_path_create(lane, CHANNEL_RING_SUFFIX);
+    lane->ring = payload_ring_create(lane->ring_path, (size_t)capacity);
+    if(lane->ring==NULL) {
+        return false;
+    }
+    lane->shm->ring_capacity = lane->ring->capacity;
+    proxy_log("INFO", "proxy %s %s payload ring %s capacity %lu", proxy_name, lane->rest ? "rest" : "channel", lane->ring_path, lane->ring->capacity);
 
     return true;
 }
 
-static void proxy_channel_shm_idle() {
-    proxy_channel_shm->state = CHANNEL_IDLE;
-    proxy_channel_shm->rid[0] = 0; //request id
-    proxy_channel_shm->payload_buff_length = 0;
+//caller holds the lane lock or the lane threads are not started yet
+static void proxy_channel_wakeup_bind(ProxyChannelLane *lane, enum ProxyWakeupBackend backend, unsigned int spin) {
+    wakeup_bind(&lane->dispatcher_wakeup, backend, spin, &lane->shm->lock, &lane->shm->dispatcher_wakeup, &lane->shm->dispatcher_word);
+    wakeup_bind(&lane->proxy_wakeup, backend, spin, &lane->shm->lock, &lane->shm->proxy_wakeup, &lane->shm->proxy_word);
+    wakeup_bind(&lane->idle, backend, spin, &lane->shm->lock, &lane->shm->idle, &lane->shm->idle_word);
+    lane->shm->wakeup = backend;
+    lane->shm->wakeup_spin = spin;
 }
 
-static char *proxy_channel_create_unsubscribe_task_key(const char *service_name, const cJSON *payload, enum ProxyServiceStatus *status, const char**rid)
-{
-    cJSON *item;
-    char *unsubscribe_task_key;
+static void proxy_channel_lane_destroy(ProxyChannelLane *lane) {
+    if(lane->ring!=NULL || lane->ring_path!=NULL) {
+        payload_ring_destroy(lane->ring, lane->ring_path, proxy_channel_shm_unlink);
+        lane->ring = NULL;
+        free(lane->ring_path);
+        lane->ring_path = NULL;
+    }
+    if(lane->shm!=NULL) {
+        if(proxy_channel_shm_unlink) {
+            //conds are left alone, they live in the unlinked segment only and pthread_cond_destroy blocks on a waiter killed in its wait
+            pthread_mutex_destroy(&lane->shm->lock);
+        }
+        munmap(lane->shm, sizeof(ProxyChannelShm));
+        lane->shm = NULL;   
+    }
+    if(lane->path!=NULL) {
+        if(proxy_channel_shm_unlink) {
+            shm_unlink(lane->path);
+        }
+        free(lane->path);
+        lane->path = NULL;
+    }
+}
 
-    *rid = NULL;
+static void proxy_channel_shm_idle(ProxyChannelLane *lane) {
+    lane->shm->state = CHANNEL_IDLE;
+    lane->shm->rid[0] = 0; //request id
+    lane->shm->payload_buff_length = 0;
+    memset(&lane->shm->payload_slot, 0, sizeof(ProxyRingSlot));
+    memset(&lane->shm->answer_slot, 0, sizeof(ProxyRingSlot));
+    lane->shm->request_count = 0;
+}
 
-    if(payload==NULL) {
-        proxy_log("ERROR", "multirespond unsubscribe service %s does not have payload", service_name);
-        *status = PROXYSERVICESTATUS_MULTIRESPOND_CLEAR_PAYLOAD_MISSING;
-        return NULL;
+static bool proxy_channel_exchange(ProxyChannelLane *lane) {
+    ChannelRequest request;
+    bool alive, comm_awake = false, subscribe_awake = false;
+
+    if(parse_worker_count()>0) {
+        return proxy_channel_exchange_deferred(lane, false);
     }
 
-    item = payload!=NULL ? cJSON_GetObjectItem(payload, SERVICE_RID_KEY) : NULL;
-    *rid = (const char*)(item!=NULL ? cJSON_GetStringValue(item) : NULL);
-    if(*rid==NULL || strlen(*rid)<1) {
-        proxy_log("ERROR", "multirespond unsubscribe service %s payload does not have rid under key %s", service_name, SERVICE_RID_KEY);
-        *status = PROXYSERVICESTATUS_MULTIRESPOND_CLEAR_PAYLOAD_RID_MISSING;
-        return NULL;
+    if(proxy_channel_request_read(lane, lane->shm->rid, lane->shm->payload_buff_length, &lane->shm->payload_slot, &request)) {
+        lane->shm->state = CHANNEL_ACKNOWLEDGED;
+    } else {
+        lane->shm->state = CHANNEL_FAILS;
     }
+    wakeup_signal(&lane->dispatcher_wakeup); 
 
-    unsubscribe_task_key = respond_table_dup_task_key(RESPONDTABLE_MULTIRESPOND, *rid);
-    if(unsubscribe_task_key==NULL) {
-        proxy_log("ERROR", "multirespond unsubscribe service %s rid does not exists", service_name);
-        *status = PROXYSERVICESTATUS_MULTIRESPOND_CLEAR_PAYLOAD_RID_INVALID;
-        return NULL;        
+    alive = proxy_channel_waitfor_done(lane);
+    if(alive && request.service_and_payload!=NULL && lane->shm->state==CHANNEL_DONE) {
+        channel_request_dispatch(lane->shm->rid, &request, &comm_awake, &subscribe_awake);
     }
+    channel_request_clear(&request);
 
-    *status = PROXYSERVICESTATUS_MULTIRESPOND_CLEAR_SUCCESS;
-    return unsubscribe_task_key;
+    if(comm_awake) {
+        proxy_comm_awake();
+    }
+    if(subscribe_awake) {
+        proxy_subscribe_awake();
+    }
+    return alive;
 }
 
-static bool proxy_channel_exchange(void) {
-    cJSON *service_and_payload, *norm_service_and_payload, *normalized_payload, *service, *payload;
-    bool new_job;
-    const char *service_name;
-    unsigned int invalid_status;
-    char *task_key, *unsubscribe_task_key;
-    const char *request_uuid;
-    enum ProxyPayloadParseResult parseResult = PARSE_INVALID;
-    enum RespondTableType respond_table_type;
-    bool alive = true, unsubscribe = false;
-    enum ProxyServiceStatus proxy_service_status;
-
-    norm_service_and_payload = NULL;
-    normalized_payload = NULL;
-    invalid_status = 0;
-    payload = NULL;    
-    unsubscribe_task_key = NULL;
-    service_name = "";
-
-    service_and_payload = proxy_channel_payload_shm_read(proxy_channel_shm->rid, proxy_channel_shm->payload_buff_length);
-    if(service_and_payload==NULL) {
-        proxy_channel_shm->state = CHANNEL_FAILS;        
-    } else {
-        service = cJSON_GetObjectItem(service_and_payload, SERVICE_SERVICE_KEY);
-        payload = cJSON_GetObjectItem(service_and_payload, SERVICE_PAYLOAD_KEY);//optional
-        service_name = service!=NULL ? cJSON_GetStringValue(service) : "";
-        if(strcmp(service_name, GONGGOSERVICE_REQUEST_DROP)==0) {
-            parseResult = PARSE_SINGLESHOT;
-            normalized_payload = payload;
-            unsubscribe = true;
-        } else {
-            parseResult = proxy_channel_payload_parse(service_name, payload, &normalized_payload, &unsubscribe, &invalid_status);
-        }
-        proxy_channel_shm->state = CHANNEL_ACKNOWLEDGED;
+static bool proxy_channel_exchange_batch(ProxyChannelLane *lane) {
+    ChannelRequest requests[CHANNEL_BATCH_MAX];
+    ProxyRequestRecord *record;
+    unsigned int i, count;
+    bool alive, comm_awake = false, subscribe_awake = false;
+
+    if(parse_worker_count()>0) {
+        return proxy_channel_exchange_deferred(lane, true);
     }
-    pthread_cond_signal(&proxy_channel_shm->dispatcher_wakeup); 
 
-    do {
-        proxy_log("INFO", "proxy %s channel waits proxy_wakeup after signaling dispatcher_wakeup", proxy_name);
-        if(pthread_cond_wait(&proxy_channel_shm->proxy_wakeup, &proxy_channel_shm->lock)==EOWNERDEAD){
-            proxy_log("INFO", "proxy %s channel detects inconsistent mutex while waiting proxy_wakeup", proxy_name);
-            pthread_mutex_consistent(&proxy_channel_shm->lock);
-            alive = false;
-            break;
-        }
-        proxy_log("INFO", "proxy %s channel got proxy_wakeup signals with status %ld", proxy_name, proxy_channel_shm->state);
-        if(proxy_channel_shm->state == CHANNEL_TERMINATION) {
-            alive = false;
-            break;
-        }
-        if(service_and_payload!=NULL && proxy_channel_shm->state==CHANNEL_DONE) {
-            if(parseResult==PARSE_INVALID) {
-                reply_queue_append_invalid_status(proxy_channel_shm->rid, invalid_status);
-                proxy_subscribe_awake();
-            } else {                
-                proxy_service_status = PROXYSERVICESTATUS_MULTIRESPOND_CLEAR_SUCCESS;
-                if(unsubscribe) {
-                    unsubscribe_task_key = proxy_channel_create_unsubscribe_task_key(service_name, payload, &proxy_service_status, &request_uuid);
-                    if(unsubscribe_task_key==NULL) {
-                        reply_queue_append_invalid_status(proxy_channel_shm->rid, proxy_service_status);
-                        proxy_subscribe_awake();
-                    } else {
-                        task_key = cJSON_PrintUnformatted(service_and_payload);                        
-                        parse_queue_append(task_key, unsubscribe_task_key, request_uuid, RESPONDTABLE_SINGLESHOT);
-                        respond_table_set(RESPONDTABLE_SINGLESHOT, task_key, proxy_channel_shm->rid);
-                        proxy_comm_awake();
-                        free(task_key);
-                    }
-                } else {
-                    if(payload==NULL || payload==normalized_payload) {
-                        norm_service_and_payload = service_and_payload;
-                    } else {
-                        norm_service_and_payload = cJSON_CreateObject();
-                        cJSON_AddItemToObject(norm_service_and_payload, SERVICE_SERVICE_KEY, cJSON_CreateString(service_name));
-                        if(normalized_payload!=NULL) {        
-                            cJSON_AddItemToObject(norm_service_and_payload, SERVICE_PAYLOAD_KEY, cJSON_Duplicate(normalized_payload, true));
-                        }                    
-                    }
-                    task_key = cJSON_PrintUnformatted(norm_service_and_payload);            
-                    new_job = true;
-                    respond_table_type = parseResult==PARSE_MULTIRESPOND && unsubscribe_task_key==NULL ? RESPONDTABLE_MULTIRESPOND
-                        : RESPONDTABLE_SINGLESHOT;                    
-                    if(respond_table_type==RESPONDTABLE_MULTIRESPOND) {
-                        new_job = respond_table_set(RESPONDTABLE_MULTIRESPOND, task_key, proxy_channel_shm->rid);
-                    } else {
-                        respond_table_set(RESPONDTABLE_SINGLESHOT, task_key, proxy_channel_shm->rid);
-                    }
-                    if(new_job) {
-                        parse_queue_append(task_key, NULL, NULL, respond_table_type);
-                        proxy_comm_awake();
-                    }
-                    free(task_key);
-                }
-            }//if(parseResult!=PARSE_INVALID) {
+    count = proxy_channel_batch_count(lane);
+
+    for(i=0; i<count; i++) {
+        record = &lane->shm->requests[i];
+        record->failed = !proxy_channel_request_read(lane, record->rid, record->payload_buff_length, &record->payload_slot, &requests[i]);
+    }
+    lane->shm->state = count>0 ? CHANNEL_ACKNOWLEDGED : CHANNEL_FAILS;
+    wakeup_signal(&lane->dispatcher_wakeup); 
+
+    alive = proxy_channel_waitfor_done(lane);
+    for(i=0; i<count; i++) {
+        if(alive && requests[i].service_and_payload!=NULL && lane->shm->state==CHANNEL_DONE) {
+            channel_request_dispatch(lane->shm->requests[i].rid, &requests[i], &comm_awake, &subscribe_awake);
         }
-    } while(false);
+        channel_request_clear(&requests[i]);
+    }
 
-    if(unsubscribe_task_key!=NULL) {
-        free(unsubscribe_task_key);
+    if(comm_awake) {
+        proxy_comm_awake();
     }
-    if(normalized_payload!=NULL && (payload==NULL || normalized_payload!=payload)) {
-        cJSON_Delete(normalized_payload);
+    if(subscribe_awake) {
+        proxy_subscribe_awake();
     }
-    if(norm_service_and_payload!=NULL && (service_and_payload==NULL || norm_service_and_payload!=service_and_payload)) {
-        cJSON_Delete(norm_service_and_payload);
+    return alive;
+}
+
+//payloads are copied while dispatcher waits, parse workers parse them once the handshake is done
+static bool proxy_channel_exchange_deferred(ProxyChannelLane *lane, bool batch) {
+    char *texts[CHANNEL_BATCH_MAX];
+    size_t lengths[CHANNEL_BATCH_MAX];
+    TraceContext traces[CHANNEL_BATCH_MAX];
+    ProxyRequestRecord *record;
+    unsigned int i, count;
+    bool alive;
+
+    if(batch) {
+        count = proxy_channel_batch_count(lane);
+        for(i=0; i<count; i++) {
+            record = &lane->shm->requests[i];
+            trace_begin(&traces[i], record->rid);
+            SAWANG_PROBE(channel__read, record->rid, record->payload_buff_length);
+            texts[i] = proxy_channel_payload_dup(lane, record->rid, record->payload_buff_length, &record->payload_slot, &lengths[i]);
+            trace_span(&traces[i], TRACE_CHANNEL_READ);
+            record->failed = texts[i]==NULL;
+            if(record->failed) {
+                metrics_add(METRICS_REQUEST_UNREADABLE, 1);
+            }
+        }
+        lane->shm->state = count>0 ? CHANNEL_ACKNOWLEDGED : CHANNEL_FAILS;
+    } else {
+        count = 1;
+        trace_begin(&traces[0], lane->shm->rid);
+        SAWANG_PROBE(channel__read, lane->shm->rid, lane->shm->payload_buff_length);
+        texts[0] = proxy_channel_payload_dup(lane, lane->shm->rid, lane->shm->payload_buff_length, &lane->shm->payload_slot, &lengths[0]);
+        trace_span(&traces[0], TRACE_CHANNEL_READ);
+        lane->shm->state = texts[0]!=NULL ? CHANNEL_ACKNOWLEDGED : CHANNEL_FAILS;
+        if(texts[0]==NULL) {
+            metrics_add(METRICS_REQUEST_UNREADABLE, 1);
+        }
     }
-    if(service_and_payload!=NULL) {
-        cJSON_Delete(service_and_payload);
+    wakeup_signal(&lane->dispatcher_wakeup); 
+
+    alive = proxy_channel_waitfor_done(lane);
+    for(i=0; i<count; i++) {
+        if(texts[i]==NULL) {
+            continue;
+        }
+        if(alive && lane->shm->state==CHANNEL_DONE) {
+            parse_worker_submit(batch ? lane->shm->requests[i].rid : lane->shm->rid, texts[i], lengths[i], &traces[i]);
+        } else {
+            free(texts[i]);
+        }
     }
 
     return alive;
 }
 
+static unsigned int proxy_channel_batch_count(ProxyChannelLane *lane) {
+    if(lane->shm->request_count>CHANNEL_BATCH_MAX) {
+        proxy_log("ERROR", "proxy %s channel batch of %u exceeds %d requests", proxy_name, lane->shm->request_count, CHANNEL_BATCH_MAX);
+        return 0;
+    }
+    return lane->shm->request_count;
+}
+
+static bool proxy_channel_waitfor_done(ProxyChannelLane *lane) {
+    uint64_t start;
+
+    proxy_log("INFO", "proxy %s channel waits proxy_wakeup after signaling dispatcher_wakeup", proxy_name);
+    start = metrics_now();
+    if(wakeup_wait(&lane->proxy_wakeup)==EOWNERDEAD){
+        proxy_log("INFO", "proxy %s channel detects inconsistent mutex while waiting proxy_wakeup", proxy_name);
+        pthread_mutex_consistent(&lane->shm->lock);
+        return false;
+    }
+    metrics_observe(METRICS_CHANNEL_HANDSHAKE, start);
+    proxy_log("INFO", "proxy %s channel got proxy_wakeup signals with status %ld", proxy_name, lane->shm->state);
+    return lane->shm->state != CHANNEL_TERMINATION;
+}
+
+//client requests are not accepted on a REST lane, dispatcher has to send them through a channel lane
+static bool proxy_channel_refuse(ProxyChannelLane *lane) {
+    lane->shm->state = CHANNEL_FAILS;
+    wakeup_signal(&lane->dispatcher_wakeup); 
+    return proxy_channel_waitfor_done(lane);
+}
+
+//return false when payload can not be read
+static bool proxy_channel_request_read(ProxyChannelLane *lane, const char *rid, size_t buff_length, const ProxyRingSlot *slot, ChannelRequest *request) {
+    bool parsed;
+
+    trace_begin(&request->trace, rid);
+    SAWANG_PROBE(channel__read, rid, buff_length);
+    parsed = channel_request_parse(proxy_channel_payload_read(lane, rid, buff_length, slot), request);
+    trace_span(&request->trace, TRACE_CHANNEL_READ);
+
+    return parsed;
+}
+
 static char* proxy_channel_respond_create(int code, const char* err, cJSON *json) {
     cJSON *respond;
     char *s;
@@ -378,21 +571,23 @@ static char* proxy_channel_respond_create(int code, const char* err, cJSON *json
     return s;
 }
 
-static bool proxy_channel_rest(const ConfVar *cv_head) {
+static bool proxy_channel_rest(ProxyChannelLane *lane, const ConfVar *cv_head) {
     bool alive = true;
     cJSON *service_and_payload = NULL, *service, *payload;
     const char *endpoint;
     char *respond = NULL, *answer_path;
     ProxyRestRespond rest_respond;
+    uint64_t start;
     
     respond = NULL;
+    metrics_add(METRICS_REQUEST_REST, 1);
 
     do {
         if(proxy_rest==NULL) {
             respond = proxy_channel_respond_create(503, "REST handler is not implemented", NULL);
             break;
         }
-        service_and_payload = proxy_channel_payload_shm_read(proxy_channel_shm->rid, proxy_channel_shm->payload_buff_length);
+        service_and_payload = proxy_channel_payload_read(lane, lane->shm->rid, lane->shm->payload_buff_length, &lane->shm->payload_slot);
         if(service_and_payload==NULL) {
             respond = proxy_channel_respond_create(500, "REST payload read is failed", NULL);
             break;
@@ -418,32 +613,128 @@ static bool proxy_channel_rest(const ConfVar *cv_head) {
     } while(false);
 
     if(respond!=NULL) {
-        proxy_uuid_generate(proxy_channel_shm->aid);
-        answer_path = (char*)malloc(strlen(proxy_channel_shm->aid) + 2);
-        sprintf(answer_path, "/%s", proxy_channel_shm->aid);
-        proxy_channel_shm->answer_buff_length = proxy_rest_create_answer(answer_path, respond);
-        if(proxy_channel_shm->answer_buff_length>0) {
-            proxy_channel_shm->state = CHANNEL_REST_RESPOND;
-            pthread_cond_signal(&proxy_channel_shm->dispatcher_wakeup);
-            if(pthread_cond_wait(&proxy_channel_shm->proxy_wakeup, &proxy_channel_shm->lock)==EOWNERDEAD){
-                pthread_mutex_consistent(&proxy_channel_shm->lock);
+        answer_path = NULL;
+        if(!proxy_rest_answer_ring_write(lane, respond)) {
+            proxy_uuid_generate(lane->shm->aid);
+            answer_path = (char*)malloc(strlen(lane->shm->aid) + 2);
+            sprintf(answer_path, "/%s", lane->shm->aid);
+            lane->shm->answer_buff_length = proxy_rest_create_answer(answer_path, respond);
+        }
+        if(lane->shm->answer_buff_length>0) {
+            lane->shm->state = CHANNEL_REST_RESPOND;
+            wakeup_signal(&lane->dispatcher_wakeup);
+            start = metrics_now();
+            if(wakeup_wait(&lane->proxy_wakeup)==EOWNERDEAD){
+                pthread_mutex_consistent(&lane->shm->lock);
                 alive = false;
+            } else {
+                metrics_observe(METRICS_REST_HANDSHAKE, start);
+            }
+            if(answer_path!=NULL) {
+                shm_unlink(answer_path);
             }
-            shm_unlink(answer_path);
         }
         free(respond);
-        free(answer_path);
+        if(answer_path!=NULL) {
+            free(answer_path);
+        } else {
+            //gonggo reads the answer in place before acknowledging, the slot is recycled right away
+            payload_ring_release(lane->ring, &lane->shm->answer_slot);
+        }
     }
 
     return alive;
 }
 
+static cJSON* proxy_channel_payload_read(ProxyChannelLane *lane, const char *rid, size_t buff_length, const ProxyRingSlot *slot) {
+    if(slot->sequence!=0) {
+        return proxy_channel_payload_ring_read(lane, slot);
+    }
+    return proxy_channel_payload_shm_read(rid, buff_length);
+}
+
+static cJSON* proxy_channel_payload_ring_read(ProxyChannelLane *lane, const ProxyRingSlot *slot) {
+    char *data;
+    cJSON *json;
+
+    data = proxy_channel_payload_ring_data(lane, slot);
+    if(data==NULL) {
+        return NULL;
+    }
+
+    json = cJSON_ParseWithLength(data, slot->length);
+    payload_ring_release(lane->ring, slot);
+
+    return json;
+}
+
+static char* proxy_channel_payload_ring_data(ProxyChannelLane *lane, const ProxyRingSlot *slot) {
+    char *data;
+
+    if(lane->ring==NULL) {
+        proxy_log("ERROR", "proxy %s receives channel payload ring slot while the ring is disabled", proxy_name);
+        return NULL;
+    }
+
+    data = payload_ring_slot_data(lane->ring, slot);
+    if(data==NULL) {
+        proxy_log("ERROR", "proxy %s receives invalid channel payload ring slot sequence %lu offset %lu length %lu", 
+            proxy_name, slot->sequence, slot->offset, slot->length);
+    }
+    return data;
+}
+
 static cJSON* proxy_channel_payload_shm_read(const char *rid, size_t buff_length) {
+    char *map;
+    cJSON *json;
+
+    map = proxy_channel_payload_shm_map(rid, buff_length);
+    if(map==NULL) {
+        return NULL;
+    }
+
+    json = cJSON_Parse(map);
+    munmap(map, buff_length);
+
+    return json;
+}
+
+//copy the raw payload so that it can be parsed outside the channel lock
+static char* proxy_channel_payload_dup(ProxyChannelLane *lane, const char *rid, size_t buff_length, const ProxyRingSlot *slot, size_t *length) {
+    char *data, *text;
+
+    if(slot->sequence!=0) {
+        data = proxy_channel_payload_ring_data(lane, slot);
+        if(data==NULL) {
+            return NULL;
+        }
+        *length = slot->length;
+        text = (char*)malloc(*length + 1);
+        memcpy(text, data, *length);
+        text[*length] = 0;
+        payload_ring_release(lane->ring, slot);
+        return text;
+    }
+
+    data = proxy_channel_payload_shm_map(rid, buff_length);
+    if(data==NULL) {
+        return NULL;
+    }
+    *length = strnlen(data, buff_length);
+    text = (char*)malloc(*length + 1);
+    memcpy(text, data, *length);
+    text[*length] = 0;
+    munmap(data, buff_length);
+
+    return text;
+}
+
+//caller unmaps the returned buff_length bytes
+static char* proxy_channel_payload_shm_map(const char *rid, size_t buff_length) {
     char *path;
     int fd;
     char buff[PROXYLOGBUFLEN];
     char *map;
-    cJSON *json;
 
     path = (char*)malloc( strlen(rid)+2 );
     sprintf(path, "/%s", rid);
@@ -465,12 +756,10 @@ static cJSON* proxy_channel_payload_shm_read(const char *rid, size_t buff_length
         return NULL;
     }
 
-    json = cJSON_Parse(map);
-    munmap(map, buff_length);
     free(path);
     close(fd);
 
-    return json;
+    return map;
 }
 
 static size_t proxy_rest_create_answer(const char *path, const char *respond) {
@@ -507,4 +796,24 @@ static size_t proxy_rest_create_answer(const char *path, const char *respond) {
     }
 
     return buff_len;
+}
+
+static bool proxy_rest_answer_ring_write(ProxyChannelLane *lane, const char *respond) {
+    size_t length;
+    char *data;
+
+    if(lane->ring==NULL) {
+        return false;
+    }
+
+    length = strlen(respond) + 1;
+    if(!payload_ring_reserve(lane->ring, length, &lane->shm->answer_slot)) {
+        return false;//too large or ring is full, fall back to aid shm
+    }
+    data = payload_ring_slot_data(lane->ring, &lane->shm->answer_slot);
+    memcpy(data, respond, length);
+    lane->shm->aid[0] = 0;
+    lane->shm->answer_buff_length = length;
+
+    return true;
 }
\ No newline at end of file
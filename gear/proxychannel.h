@@ -5,12 +5,14 @@
 
 #include "callback.h"
 
-extern bool proxy_channel_context_init(ProxyPayloadParse f_payload_parse, ProxyRest f_rest);
+extern bool proxy_channel_context_init(const ConfVar *cv_head, ProxyPayloadParse f_payload_parse, ProxyRest f_rest);
 extern void proxy_channel_shm_unlink_enable(void);
+extern void proxy_channel_wakeup_condvar(void);//before activation completes with a gonggo not knowing the wakeup fields
 extern void proxy_channel_context_destroy(void);
-extern void* proxy_channel(void *arg);
-extern void proxy_channel_waitfor_started(void);
-extern bool proxy_channel_isstarted(void);
+extern unsigned int proxy_channel_lane_count(void);
+extern void* proxy_channel(void *arg);//arg is the lane index, REST lanes follow the channel lanes
+extern void proxy_channel_waitfor_started(unsigned int lane_index);
+extern bool proxy_channel_isstarted(unsigned int lane_index);
 extern void proxy_channel_stop(void);
 
 #endif //_PROXYCHANNEL_H_
\ No newline at end of file
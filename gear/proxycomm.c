@@ -1,71 +1,70 @@
 #include <unistd.h>
+#include <stdlib.h>
 
 #include "proxycomm.h"
 #include "proxysubscribe.h"
 #include "respondtable.h"
 #include "replyqueue.h"
 #include "parsequeue.h"
+#include "proxytask.h"
 #include "log.h"
 #include "proxyservicestatus.h"
+#include "doorbell.h"
+#include "metrics.h"
+#include "trace.h"
+#include "probe.h"
 
 //property
 static volatile bool proxy_comm_started = false;
-static bool proxy_comm_end = false;
+static volatile bool proxy_comm_end = false;
 static ProxyStart proxy_comm_f_start = NULL;
 static ProxyRun proxy_comm_f_run = NULL;
 static ProxyMultiRespondClear proxy_comm_f_multirespond_clear = NULL;
 static ProxyStop proy_comm_f_stop = NULL;
-static pthread_mutex_t proxy_comm_lock;
-static pthread_cond_t proxy_comm_wakeup;
+static Doorbell proxy_comm_doorbell;//rung by parse_queue producers and stop
 
 //function
 static void proxy_comm_reply(const ProxyReplyArg *arg, cJSON *headers, cJSON *payload);
 static void proxy_comm_drop_multirespond_request(const cJSON *payload);
-static ProxyReplyArg *proxy_comm_create_reply_arg(const char *task_key);
+static ProxyReplyArg *proxy_comm_create_reply_arg(TaskKey *task_key);
+static ProxyReplyArg *proxy_comm_take_reply_arg(ParseQueueTask *task);
 static void proxy_comm_free(ProxyReplyArg *arg);
-static char *task_key_from_reply_arg(const ProxyReplyArg *arg);
+static TaskKey *proxy_comm_task_key_from_arg(const ProxyReplyArg *arg);//return a new reference
 
 void proxy_comm_context_init(ProxyStart f_start, ProxyRun f_run, ProxyMultiRespondClear f_multirespond_clear, ProxyStop f_stop) 
 {
-    pthread_mutexattr_t mutexattr;
-    pthread_condattr_t condattr;
-
     proxy_comm_f_start = f_start;
     proxy_comm_f_run = f_run;
     proxy_comm_f_multirespond_clear = f_multirespond_clear;
     proy_comm_f_stop = f_stop;
 
-    pthread_mutexattr_init(&mutexattr);
-    pthread_mutexattr_setpshared(&mutexattr, PTHREAD_PROCESS_PRIVATE);
-    pthread_mutexattr_setrobust(&mutexattr, PTHREAD_MUTEX_ROBUST);
-    pthread_mutexattr_settype(&mutexattr, PTHREAD_MUTEX_NORMAL);
-    pthread_mutex_init(&proxy_comm_lock, &mutexattr);
-    pthread_mutexattr_destroy(&mutexattr);//mutexattr is no longer needed
-
-    pthread_condattr_init(&condattr);
-    pthread_condattr_setpshared(&condattr, PTHREAD_PROCESS_PRIVATE);
-    pthread_cond_init(&proxy_comm_wakeup, &condattr);
-    pthread_condattr_destroy(&condattr);//condattr is no longer neededs    
+    doorbell_init(&proxy_comm_doorbell);
 }
 
 void proxy_comm_context_destroy(void) {
-    pthread_mutex_destroy(&proxy_comm_lock);
-    pthread_cond_destroy(&proxy_comm_wakeup);
+    //the doorbell holds no kernel resource
 }
 
 void* proxy_comm(void *arg) {
     ParseQueueTask *task;
     ProxyReplyArg *reply_arg;
     guint remaining;
+    uint32_t sequence;
+    uint64_t start;
+    TraceContext trace;
     bool run;
 
     proxy_comm_started = true;
     if(proxy_comm_f_start!=NULL) { 
         proxy_comm_f_start((const ProxyCommData*)arg);
     }
-    pthread_mutex_lock(&proxy_comm_lock);
     while(!proxy_comm_end) {
+        sequence = doorbell_sequence(&proxy_comm_doorbell);
         while( (task=parse_queue_pop_head())!=NULL ) {
+            if(task->task!=NULL) {
+                trace_span(&task->task->trace, TRACE_PARSE_QUEUE);
+            }
+            SAWANG_PROBE(comm__pop, task->task!=NULL ? task->task->arg.service : "", parse_queue_depth());
             if(task->type==RESPONDTABLE_SINGLESHOT || task->type==RESPONDTABLE_MULTIRESPOND) {
                 run = true;
                 if((task->type==RESPONDTABLE_SINGLESHOT && task->unsubscribe_task_key!=NULL && task->unsubscribe_uuid!=NULL)) {
@@ -79,7 +78,7 @@ void* proxy_comm(void *arg) {
                     if(reply_arg!=NULL) {
                         proxy_comm_free(reply_arg);
                     }
-                    reply_arg = proxy_comm_create_reply_arg(task->task_key);
+                    reply_arg = proxy_comm_take_reply_arg(task);
                     cJSON *headers = cJSON_CreateObject();
                     cJSON_AddNumberToObject(headers, SERVICE_STATUS_KEY, PROXYSERVICESTATUS_MULTIRESPOND_CLEAR_SUCCESS);
                     cJSON *payload = cJSON_CreateObject();
@@ -89,20 +88,27 @@ void* proxy_comm(void *arg) {
                     run = false;
                 }
                 if(run) {
-                    reply_arg = proxy_comm_create_reply_arg(task->task_key);
+                    reply_arg = proxy_comm_take_reply_arg(task);
                     if(strcmp(reply_arg->service, GONGGOSERVICE_REQUEST_DROP)==0) {
                         proxy_comm_drop_multirespond_request(reply_arg->payload);
                         proxy_comm_free(reply_arg);
                     } else if(proxy_comm_f_run!=NULL){
+                        start = metrics_now();
+                        trace = proxy_task_from_arg(reply_arg)->trace;//ProxyRun may free reply_arg
+                        SAWANG_PROBE(comm__run__start, reply_arg->service);
                         proxy_comm_f_run(reply_arg, proxy_comm_reply, proxy_comm_free);
+                        SAWANG_PROBE(comm__run__done);
+                        metrics_observe(METRICS_PROXY_RUN, start);
+                        trace_span(&trace, TRACE_PROXY_RUN);
                     }
                 }
             }
             parse_queue_task_destroy(task);            
         }
-        pthread_cond_wait(&proxy_comm_wakeup, &proxy_comm_lock);
+        if(!proxy_comm_end) {
+            doorbell_wait(&proxy_comm_doorbell, sequence);
+        }
     }    
-    pthread_mutex_unlock(&proxy_comm_lock);
     if(proy_comm_f_stop!=NULL) {
         proy_comm_f_stop();
     }
@@ -119,124 +125,131 @@ bool proxy_comm_isstarted(void) {
     return proxy_comm_started;
 }
 
+//no syscall while proxycomm is still draining
 void proxy_comm_awake(void) {
-    pthread_mutex_lock(&proxy_comm_lock);
-    pthread_cond_signal(&proxy_comm_wakeup);
-    pthread_mutex_unlock(&proxy_comm_lock);    
+    doorbell_ring(&proxy_comm_doorbell);
 }
 
 void proxy_comm_stop(void) {
-    pthread_mutex_lock(&proxy_comm_lock);
     proxy_comm_end = true;
-    pthread_cond_signal(&proxy_comm_wakeup);
-    pthread_mutex_unlock(&proxy_comm_lock);
+    doorbell_ring(&proxy_comm_doorbell);
 }
 
 static void proxy_comm_reply(const ProxyReplyArg *arg, cJSON *headers, cJSON *payload) {
-    cJSON *rid;
-    guint i;
-    char *task_key, *request_uuid;
-    GPtrArray *request_uuid_arr; 
+    guint cursor;
+    const ProxyTask *task;
+    TaskKey *task_key;
+    char request_uuid[UUIDBUFLEN];
+    uuid_t bin_uuid;
+    RidSnapshot *snapshot; 
     enum RespondTableType which;
 
-    task_key = task_key_from_reply_arg(arg);
+    //a proxy replying with an arg it built or copied gets the task key rebuilt from service and payload
+    task = proxy_task_from_arg(arg);
+    task_key = task!=NULL ? task_key_ref(task->key) : proxy_comm_task_key_from_arg(arg);
     
     which = RESPONDTABLE_SINGLESHOT;    
-    if((request_uuid_arr = respond_table_request_dup(which, task_key))==NULL){
+    if((snapshot = respond_table_snapshot(which, task_key))==NULL){
         which = RESPONDTABLE_MULTIRESPOND;
-        request_uuid_arr = respond_table_request_dup(which, task_key);
+        snapshot = respond_table_snapshot(which, task_key);
     }
-    if(request_uuid_arr==NULL) {
-        free(task_key);
+    SAWANG_PROBE(comm__reply, arg->service, snapshot!=NULL ? snapshot->set->count : 0, which==RESPONDTABLE_MULTIRESPOND);
+    if(snapshot==NULL || snapshot->set->count<1) {
+        rid_snapshot_unref(snapshot);
+        task_key_unref(task_key);
+        cJSON_Delete(headers);
+        cJSON_Delete(payload);
         return;
     }
 
-    rid = NULL;
-    if(request_uuid_arr->len > 1) {//an array
-        rid = cJSON_CreateArray();
-        for(i=0; i<request_uuid_arr->len; i++) {
-            request_uuid = (char*)g_ptr_array_index(request_uuid_arr, i);
-            cJSON_AddItemToArray(rid, cJSON_CreateString(request_uuid));
-            if(which==RESPONDTABLE_SINGLESHOT) {
-                respond_table_drop(RESPONDTABLE_SINGLESHOT, task_key, request_uuid, NULL);                   
-            }
+    //the snapshot stays as it is while referenced, its serialized rid is shared by every reply until the next (un)subscribe
+    if(which==RESPONDTABLE_SINGLESHOT && snapshot->set->count > 1) {
+        cursor = 0;
+        while(rid_set_next(snapshot->set, &cursor, bin_uuid)) {
+            uuid_unparse_lower(bin_uuid, request_uuid);
+            respond_table_drop(RESPONDTABLE_SINGLESHOT, task_key, request_uuid, NULL);                   
         }
-    } else if(request_uuid_arr->len==1) {
-        request_uuid = (char*)g_ptr_array_index(request_uuid_arr, 0);
-        rid = cJSON_CreateString(request_uuid);
-    }
-    g_ptr_array_free(request_uuid_arr, true);
-    free(task_key);
-
-    if(rid!=NULL) {
-        reply_queue_append(rid, headers, payload, which==RESPONDTABLE_MULTIRESPOND);
-        proxy_subscribe_awake();
     }
+    reply_queue_append_rid_text(rid_snapshot_text(snapshot), headers, payload, which==RESPONDTABLE_MULTIRESPOND, 
+        task!=NULL ? &task->trace : NULL);
+    rid_snapshot_unref(snapshot);
+    task_key_unref(task_key);
+    proxy_subscribe_awake();
 }
 
 static void proxy_comm_drop_multirespond_request(const cJSON *payload) {
     cJSON *arr, *item;
     int len, i;
-    const char *request_uuid;
-    char *unsubscribe_task_key;
-    guint remaining;
+    const char **request_uuids;
+    GPtrArray *emptied;
     ProxyReplyArg *reply_arg;
 
     arr = cJSON_GetObjectItem(payload, SERVICE_RID_KEY);
     len = arr!=NULL ? cJSON_GetArraySize(arr) : 0;
-    for(i=0; i<len; i++) {
-        item = cJSON_GetArrayItem(arr, i);
-        request_uuid = cJSON_GetStringValue(item);        
-        unsubscribe_task_key = request_uuid!=NULL ? respond_table_dup_task_key(RESPONDTABLE_MULTIRESPOND, request_uuid) : NULL;
-        if(unsubscribe_task_key!=NULL) {
-            if(respond_table_drop(RESPONDTABLE_MULTIRESPOND, unsubscribe_task_key, request_uuid, &remaining)){
-                if(remaining<1 && proxy_comm_f_multirespond_clear!=NULL) {
-                    reply_arg = proxy_comm_create_reply_arg(unsubscribe_task_key);
-                    proxy_comm_f_multirespond_clear(reply_arg, proxy_comm_free);
-                }
-            }
-            free(unsubscribe_task_key);
-        }
+    if(len<1) {
+        return;
     }
-}
 
-static ProxyReplyArg *proxy_comm_create_reply_arg(const char *task_key) {
-    ProxyReplyArg *arg;
-    cJSON *j, *item;
+    request_uuids = (const char**)malloc(len * sizeof(const char*));
+    i = 0;
+    cJSON_ArrayForEach(item, arr) {
+        request_uuids[i++] = cJSON_GetStringValue(item);
+    }
+    emptied = respond_table_drop_requests(RESPONDTABLE_MULTIRESPOND, request_uuids, (guint)i);
+    free(request_uuids);
 
-    arg = (ProxyReplyArg*)malloc(sizeof(ProxyReplyArg));
-    j = cJSON_Parse(task_key);
+    for(i=0; i<(int)emptied->len && proxy_comm_f_multirespond_clear!=NULL; i++) {
+        reply_arg = proxy_comm_create_reply_arg((TaskKey*)g_ptr_array_index(emptied, i));
+        proxy_comm_f_multirespond_clear(reply_arg, proxy_comm_free);
+    }
+    g_ptr_array_free(emptied, true);
+}
 
-    item = cJSON_GetObjectItem(j, SERVICE_SERVICE_KEY);
-    arg->service = strdup(cJSON_GetStringValue(item));
+//for a task key kept by the respond table
+static ProxyReplyArg *proxy_comm_create_reply_arg(TaskKey *task_key) {
+    return &proxy_task_parse(task_key)->arg;
+}
 
-    item = cJSON_GetObjectItem(j, SERVICE_PAYLOAD_KEY);
-    arg->payload = item!=NULL ? cJSON_Duplicate(item, true) : NULL;
+//the parsed task moves to the reply arg, ProxyFree releases it
+static ProxyReplyArg *proxy_comm_take_reply_arg(ParseQueueTask *task) {
+    ProxyReplyArg *arg;
 
-    cJSON_Delete(j);
+    arg = &task->task->arg;
+    task->task = NULL;
 
     return arg;
 }
 
+//an arg the proxy built itself is released the way it was before tasks carried the arg
 static void proxy_comm_free(ProxyReplyArg *arg) {
-    free(arg->service);
-    if(arg->payload!=NULL) {
-        cJSON_Delete(arg->payload);
+    ProxyTask *task;
+
+    if((task = proxy_task_from_arg(arg))!=NULL) {
+        proxy_task_destroy(task);
+    } else if(arg!=NULL) {
+        free(arg->service);
+        if(arg->payload!=NULL) {
+            cJSON_Delete(arg->payload);
+        }
+        free(arg);
     }
-    free(arg);
 }
 
-static char *task_key_from_reply_arg(const ProxyReplyArg *arg) {
+//the payload handed to ProxyRun is already normalized and ordered, printing it again gives the interned text
+static TaskKey *proxy_comm_task_key_from_arg(const ProxyReplyArg *arg) {
     cJSON *j;
-    char *s;
+    char *text;
+    TaskKey *task_key;
 
     j = cJSON_CreateObject();
     cJSON_AddItemToObject(j, SERVICE_SERVICE_KEY, cJSON_CreateString(arg->service));
     if(arg->payload!=NULL) {
         cJSON_AddItemToObject(j, SERVICE_PAYLOAD_KEY, cJSON_Duplicate(arg->payload, true));
     }
-    s = cJSON_PrintUnformatted(j);
+    text = cJSON_PrintUnformatted(j);
+    task_key = task_key_intern(text);
+    cJSON_free(text);
     cJSON_Delete(j);
 
-    return s;
+    return task_key;
 }
\ No newline at end of file
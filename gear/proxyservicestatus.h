@@ -8,7 +8,8 @@ enum ProxyServiceStatus {
     PROXYSERVICESTATUS_MULTIRESPOND_CLEAR_SUCCESS = 3,
     PROXYSERVICESTATUS_MULTIRESPOND_CLEAR_PAYLOAD_MISSING = 4,
     PROXYSERVICESTATUS_MULTIRESPOND_CLEAR_PAYLOAD_RID_MISSING = 5,
-    PROXYSERVICESTATUS_MULTIRESPOND_CLEAR_PAYLOAD_RID_INVALID = 6
+    PROXYSERVICESTATUS_MULTIRESPOND_CLEAR_PAYLOAD_RID_INVALID = 6,
+    PROXYSERVICESTATUS_PAYLOAD_INVALID = 7
 };
 
 #endif //_PROXYSERVICESTATUS_H_
\ No newline at end of file
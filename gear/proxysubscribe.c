@@ -9,52 +9,83 @@
 
 #include "log.h"
 #include "proxy.h"
-#include "util.h"
+#include "wakeup.h"
 #include "replyqueue.h"
 #include "proxyuuid.h"
 #include "globaldata.h"
+#include "payloadring.h"
+#include "proxysubscribe.h"
+#include "doorbell.h"
+#include "metrics.h"
+#include "trace.h"
+#include "probe.h"
 
 #define SUBSCRIBE_SUFFIX "_subscribe"
+#define SUBSCRIBE_RING_SUFFIX "_subscribe_ring"
+#define SUBSCRIBE_BATCH_DEFAULT 1
 
 //property
 static char *proxy_subscribe_path = NULL;
 static volatile bool proxy_subscribe_started = false;
-static bool proxy_subscribe_end = false;
+static volatile bool proxy_subscribe_end = false;
 static bool proxy_subscribe_shm_unlink = false;
 static ProxySubscribeShm *proxy_subscribe_shm = NULL;    
-static pthread_mutex_t proxy_subscribe_lock;
-static pthread_cond_t proxy_subscribe_wakeup;
+static char *proxy_subscribe_ring_path = NULL;
+static ProxyRingShm *proxy_subscribe_ring = NULL;
+static Doorbell proxy_subscribe_doorbell;//rung by reply_queue producers and stop
+static Wakeup proxy_subscribe_dispatcher_wakeup;
+static Wakeup proxy_subscribe_proxy_wakeup;
+static unsigned int proxy_subscribe_batch_max = SUBSCRIBE_BATCH_DEFAULT;
+static long proxy_subscribe_batch_bytes = 0;
+static char *proxy_subscribe_frame = NULL;//batched answer buffer, used by subscribe thread only
+static size_t proxy_subscribe_frame_capacity = 0;
 
 //function
-static char* proxy_subscribe_path_create(void);
-static bool proxy_subscribe_shm_create(const char *proxy_path);
+static char* proxy_subscribe_path_create(const char *suffix);
+static bool proxy_subscribe_shm_create(const char *proxy_path, enum ProxyWakeupBackend backend, unsigned int spin);
+static bool proxy_subscribe_ring_create(const ConfVar *cv_head);
+static void proxy_subscribe_wakeup_bind(enum ProxyWakeupBackend backend, unsigned int spin);
 static void proxy_subscribe_shm_idle(void);
-static enum ProxySubscribeState proxy_subscribe_exchange(const ReplyQueueTask *task);
-static size_t proxy_subscribe_create_answer(const char *path, const char *task);
-
-bool proxy_subscribe_context_init(void) 
+static guint proxy_subscribe_batch_pop(GPtrArray *batch);
+static size_t proxy_subscribe_batch_frame(const GPtrArray *batch);
+static size_t proxy_subscribe_record_size(size_t text_length);
+static enum ProxySubscribeState proxy_subscribe_exchange(const GPtrArray *batch);
+static bool proxy_subscribe_answer_ring_write(const char *answer, size_t length);
+static size_t proxy_subscribe_create_answer(const char *path, const char *answer, size_t length);
+
+bool proxy_subscribe_context_init(const ConfVar *cv_head) 
 {
-    pthread_mutexattr_t mutexattr;
-    pthread_condattr_t condattr;
+    enum ProxyWakeupBackend backend;
+    unsigned int spin;
+
+    if(!wakeup_backend_parse(confvar_value(cv_head, CONF_WAKEUP), &backend)) {
+        proxy_log("ERROR", "proxy %s %s %s is unknown, condvar is used", proxy_name, CONF_WAKEUP, confvar_value(cv_head, CONF_WAKEUP));
+        backend = WAKEUP_CONDVAR;
+    }
+    if(!confvar_uint(cv_head, CONF_WAKEUP_SPIN, &spin)) {
+        spin = WAKEUP_SPIN_DEFAULT;
+    }
 
-    proxy_subscribe_path = proxy_subscribe_path_create();
-    if(!proxy_subscribe_shm_create(proxy_subscribe_path)) {
+    proxy_subscribe_path = proxy_subscribe_path_create(SUBSCRIBE_SUFFIX);
+    if(!proxy_subscribe_shm_create(proxy_subscribe_path, backend, spin)) {
         free(proxy_subscribe_path);
         proxy_subscribe_path = NULL;
         return false;
     }
+    if(!proxy_subscribe_ring_create(cv_head)) {
+        proxy_subscribe_shm_unlink_enable();
+        proxy_subscribe_context_destroy();
+        return false;
+    }
 
-    pthread_mutexattr_init(&mutexattr);
-    pthread_mutexattr_setpshared(&mutexattr, PTHREAD_PROCESS_PRIVATE);
-    pthread_mutexattr_setrobust(&mutexattr, PTHREAD_MUTEX_ROBUST);
-    pthread_mutexattr_settype(&mutexattr, PTHREAD_MUTEX_NORMAL);
-    pthread_mutex_init(&proxy_subscribe_lock, &mutexattr);
-    pthread_mutexattr_destroy(&mutexattr);//mutexattr is no longer needed
+    if(!confvar_uint(cv_head, CONF_SUBSCRIBE_BATCH, &proxy_subscribe_batch_max) || proxy_subscribe_batch_max<1) {
+        proxy_subscribe_batch_max = SUBSCRIBE_BATCH_DEFAULT;
+    }
+    if(!confvar_long(cv_head, CONF_SUBSCRIBE_BATCH_BYTES, &proxy_subscribe_batch_bytes) || proxy_subscribe_batch_bytes<0) {
+        proxy_subscribe_batch_bytes = 0;
+    }
 
-    pthread_condattr_init(&condattr);
-    pthread_condattr_setpshared(&condattr, PTHREAD_PROCESS_PRIVATE);
-    pthread_cond_init(&proxy_subscribe_wakeup, &condattr);
-    pthread_condattr_destroy(&condattr);//condattr is no longer neededs
+    doorbell_init(&proxy_subscribe_doorbell);
 
     return true;
 }
@@ -63,16 +94,34 @@ void proxy_subscribe_shm_unlink_enable(void) {
     proxy_subscribe_shm_unlink = true;
 }
 
+//an older gonggo only signals the condition variables, a waiter asleep on the word is woken to wait again on them
+void proxy_subscribe_wakeup_condvar(void) {
+    enum ProxyWakeupBackend backend;
+
+    if(proxy_subscribe_shm==NULL || proxy_subscribe_proxy_wakeup.backend==WAKEUP_CONDVAR) {
+        return;
+    }
+    if(pthread_mutex_lock(&proxy_subscribe_shm->lock)==EOWNERDEAD) {
+        pthread_mutex_consistent(&proxy_subscribe_shm->lock);
+    }
+    backend = proxy_subscribe_proxy_wakeup.backend;
+    wakeup_broadcast(&proxy_subscribe_proxy_wakeup);
+    proxy_subscribe_wakeup_bind(WAKEUP_CONDVAR, 0);
+    pthread_mutex_unlock(&proxy_subscribe_shm->lock);
+    proxy_log("INFO", "proxy %s subscribe falls back from %s to condvar wakeup for %s", proxy_name, wakeup_backend_name(backend), gonggo_name);
+}
+
 void proxy_subscribe_context_destroy(void) {
+    if(proxy_subscribe_ring!=NULL || proxy_subscribe_ring_path!=NULL) {
+        payload_ring_destroy(proxy_subscribe_ring, proxy_subscribe_ring_path, proxy_subscribe_shm_unlink);
+        proxy_subscribe_ring = NULL;
+        free(proxy_subscribe_ring_path);
+        proxy_subscribe_ring_path = NULL;
+    }
     if(proxy_subscribe_shm!=NULL) {
         if(proxy_subscribe_shm_unlink) {
+            //no pthread_cond_destroy, the conds go away with the segment and destroy would hang on a killed waiter
             pthread_mutex_destroy(&proxy_subscribe_shm->lock);
-
-            proxy_cond_reset(&proxy_subscribe_shm->dispatcher_wakeup);
-            pthread_cond_destroy(&proxy_subscribe_shm->dispatcher_wakeup);
-
-            proxy_cond_reset(&proxy_subscribe_shm->proxy_wakeup);
-            pthread_cond_destroy(&proxy_subscribe_shm->proxy_wakeup);
         }
         munmap(proxy_subscribe_shm, sizeof(ProxySubscribeShm));        
         proxy_subscribe_shm = NULL;           
@@ -84,14 +133,19 @@ void proxy_subscribe_context_destroy(void) {
         free(proxy_subscribe_path);
         proxy_subscribe_path = NULL;
     }
-    pthread_mutex_destroy(&proxy_subscribe_lock);
-    pthread_cond_destroy(&proxy_subscribe_wakeup);
+    if(proxy_subscribe_frame!=NULL) {
+        free(proxy_subscribe_frame);
+        proxy_subscribe_frame = NULL;
+        proxy_subscribe_frame_capacity = 0;
+    }
 }
 
 void* proxy_subscribe(void *arg) {
     enum ProxySubscribeState state;
     GQueue *failed_task;
-    ReplyQueueTask *task;
+    GPtrArray *batch;
+    guint i;
+    uint32_t sequence;
     bool alive = true;
  
     proxy_log("INFO", "proxy %s subscribe thread is started", proxy_name);
@@ -99,39 +153,45 @@ void* proxy_subscribe(void *arg) {
     proxy_subscribe_started = true;
 
     failed_task = g_queue_new();
-    pthread_mutex_lock(&proxy_subscribe_lock);
+    batch = g_ptr_array_sized_new(proxy_subscribe_batch_max);
     while(alive && !proxy_subscribe_end && proxy_subscribe_shm->state!=SUBSCRIBE_TERMINATION) {
+        sequence = doorbell_sequence(&proxy_subscribe_doorbell);
         proxy_subscribe_shm_idle();//set state to subscribe_IDLE
-        while( (task = reply_queue_pop_head())!=NULL ) {
+        while( proxy_subscribe_batch_pop(batch)>0 ) {
             if(pthread_mutex_lock(&proxy_subscribe_shm->lock) == EOWNERDEAD) {
                 pthread_mutex_consistent(&proxy_subscribe_shm->lock);//resurrection
                 alive = false;
             } else {
-                state = proxy_subscribe_exchange(task);
+                state = proxy_subscribe_exchange(batch);
                 alive = state!= SUBSCRIBE_TERMINATION;
             }
             pthread_mutex_unlock(&proxy_subscribe_shm->lock);
             
             if(!alive) {
-                reply_queue_task_destroy(task);                
+                g_ptr_array_foreach(batch, (GFunc)reply_queue_task_destroy, NULL);
+                g_ptr_array_set_size(batch, 0);
                 break;
             }
 
-            if(state!=SUBSCRIBE_DONE) {
-                g_queue_push_tail(failed_task, task);
-            } else {
-                reply_queue_task_destroy(task);
+            for(i=0; i<batch->len; i++) {
+                if(state!=SUBSCRIBE_DONE) {
+                    g_queue_push_tail(failed_task, g_ptr_array_index(batch, i));
+                } else {
+                    trace_span(&((ReplyQueueTask*)g_ptr_array_index(batch, i))->trace, TRACE_SUBSCRIBE_HANDSHAKE);
+                    reply_queue_task_destroy((ReplyQueueTask*)g_ptr_array_index(batch, i));
+                }
             }
+            g_ptr_array_set_size(batch, 0);
             proxy_subscribe_shm_idle();//set state to subscribe_IDLE
         }
         if(!g_queue_is_empty(failed_task)) {
             reply_queue_push_head(failed_task);
         }
-        if(alive) {
-            pthread_cond_wait(&proxy_subscribe_wakeup, &proxy_subscribe_lock);
+        if(alive && !proxy_subscribe_end) {
+            doorbell_wait(&proxy_subscribe_doorbell, sequence);
         }
     }
-    pthread_mutex_unlock(&proxy_subscribe_lock);
+    g_ptr_array_free(batch, true);
     g_queue_free_full(failed_task, (GDestroyNotify)reply_queue_task_destroy);
 
     proxy_log("INFO", "proxy %s subscribe thread is stopped", proxy_name);
@@ -148,10 +208,9 @@ bool proxy_subscribe_isstarted(void) {
     return proxy_subscribe_started;
 }
 
+//no syscall while proxysubscribe is still draining
 void proxy_subscribe_awake(void) {
-    pthread_mutex_lock(&proxy_subscribe_lock);
-    pthread_cond_signal(&proxy_subscribe_wakeup);
-    pthread_mutex_unlock(&proxy_subscribe_lock);
+    doorbell_ring(&proxy_subscribe_doorbell);
 }
 
 void proxy_subscribe_stop(void) {
@@ -159,28 +218,25 @@ void proxy_subscribe_stop(void) {
         pthread_mutex_consistent(&proxy_subscribe_shm->lock);        
     }
     proxy_subscribe_shm->state = SUBSCRIBE_TERMINATION;
-    pthread_cond_signal(&proxy_subscribe_shm->proxy_wakeup);
+    wakeup_signal(&proxy_subscribe_proxy_wakeup);
     pthread_mutex_unlock(&proxy_subscribe_shm->lock);
 
-    pthread_mutex_lock(&proxy_subscribe_lock);
     proxy_subscribe_end = true;
-    pthread_cond_signal(&proxy_subscribe_wakeup);
-    pthread_mutex_unlock(&proxy_subscribe_lock);
+    doorbell_ring(&proxy_subscribe_doorbell);
 }
 
-static char* proxy_subscribe_path_create(void) {
+static char* proxy_subscribe_path_create(const char *suffix) {
     char *shm_path;
 
-    shm_path = (char*)malloc(strlen(proxy_name) + strlen(SUBSCRIBE_SUFFIX) + 2);
-    sprintf(shm_path, "/%s%s", proxy_name, SUBSCRIBE_SUFFIX);
+    shm_path = (char*)malloc(strlen(proxy_name) + strlen(suffix) + 2);
+    sprintf(shm_path, "/%s%s", proxy_name, suffix);
     return shm_path;
 }
 
-static bool proxy_subscribe_shm_create(const char *proxy_path) {
+static bool proxy_subscribe_shm_create(const char *proxy_path, enum ProxyWakeupBackend backend, unsigned int spin) {
     int fd;
     char buff[PROXYLOGBUFLEN];
     pthread_mutexattr_t mutexattr;
-    pthread_condattr_t condattr;
 
     fd = shm_open(proxy_path, O_RDWR, S_IRUSR | S_IWUSR);
     if( errno == ENOENT ) {
@@ -188,6 +244,8 @@ static bool proxy_subscribe_shm_create(const char *proxy_path) {
         if(fd>-1) {
             ftruncate(fd, sizeof(ProxySubscribeShm)); //set size
         }
+    } else if(fd>-1) {
+        ftruncate(fd, sizeof(ProxySubscribeShm)); //grow segment left by an older layout
     }
 
     if(fd==-1) {
@@ -210,16 +268,43 @@ static bool proxy_subscribe_shm_create(const char *proxy_path) {
     }
     pthread_mutexattr_destroy(&mutexattr);//mutexattr is no longer needed
 
-    pthread_condattr_init(&condattr);
-    pthread_condattr_setpshared(&condattr, PTHREAD_PROCESS_SHARED);
-    pthread_cond_init(&proxy_subscribe_shm->dispatcher_wakeup, &condattr);
-    pthread_cond_init(&proxy_subscribe_shm->proxy_wakeup, &condattr);
-    pthread_condattr_destroy(&condattr);//condattr is no longer needed
+    proxy_subscribe_wakeup_bind(backend, spin);
+    wakeup_init(&proxy_subscribe_dispatcher_wakeup);
+    wakeup_init(&proxy_subscribe_proxy_wakeup);
 
     proxy_subscribe_shm->state = SUBSCRIBE_INIT;
     proxy_subscribe_shm->aid[0] = 0;
     proxy_subscribe_shm->payload_buff_length = 0;
     proxy_subscribe_shm->remove_request = false;
+    proxy_subscribe_shm->ring_capacity = 0;
+    memset(&proxy_subscribe_shm->answer_slot, 0, sizeof(ProxyRingSlot));
+    proxy_subscribe_shm->answer_count = 0;
+
+    return true;
+}
+
+//caller holds the segment lock or the subscribe thread is not started yet
+static void proxy_subscribe_wakeup_bind(enum ProxyWakeupBackend backend, unsigned int spin) {
+    wakeup_bind(&proxy_subscribe_dispatcher_wakeup, backend, spin, &proxy_subscribe_shm->lock, &proxy_subscribe_shm->dispatcher_wakeup, &proxy_subscribe_shm->dispatcher_word);
+    wakeup_bind(&proxy_subscribe_proxy_wakeup, backend, spin, &proxy_subscribe_shm->lock, &proxy_subscribe_shm->proxy_wakeup, &proxy_subscribe_shm->proxy_word);
+    proxy_subscribe_shm->wakeup = backend;
+    proxy_subscribe_shm->wakeup_spin = spin;
+}
+
+static bool proxy_subscribe_ring_create(const ConfVar *cv_head) {
+    long capacity;
+
+    if(!confvar_long(cv_head, CONF_SUBSCRIBE_RING, &capacity) || capacity<1) {
+        return true;//ring is optional, answer is written to the aid shm
+    }
+
+    proxy_subscribe_ring_path = proxy_subscribe_path_create(SUBSCRIBE_RING_SUFFIX);
+    proxy_subscribe_ring = payload_ring_create(proxy_subscribe_ring_path, (size_t)capacity);
+    if(proxy_subscribe_ring==NULL) {
+        return false;
+    }
+    proxy_subscribe_shm->ring_capacity = proxy_subscribe_ring->capacity;
+    proxy_log("INFO", "proxy %s subscribe answer ring %s capacity %lu", proxy_name, proxy_subscribe_ring_path, proxy_subscribe_ring->capacity);
 
     return true;
 }
@@ -229,42 +314,140 @@ static void proxy_subscribe_shm_idle(void) {
     proxy_subscribe_shm->aid[0] = 0;
     proxy_subscribe_shm->payload_buff_length = 0;
     proxy_subscribe_shm->remove_request = false;
+    memset(&proxy_subscribe_shm->answer_slot, 0, sizeof(ProxyRingSlot));
+    proxy_subscribe_shm->answer_count = 0;
+}
+
+static guint proxy_subscribe_batch_pop(GPtrArray *batch) {
+    ReplyQueueTask *task;
+    long bytes;
+
+    bytes = 0;
+    while( batch->len<proxy_subscribe_batch_max && (task = reply_queue_pop_head())!=NULL ) {
+        g_ptr_array_add(batch, task);
+        trace_span(&task->trace, TRACE_REPLY_QUEUE);
+        bytes += strlen(task->task) + 1;
+        if(proxy_subscribe_batch_bytes>0 && bytes>=proxy_subscribe_batch_bytes) {
+            break;
+        }
+    }
+    return batch->len;
+}
+
+static size_t proxy_subscribe_batch_frame(const GPtrArray *batch) {
+    const ReplyQueueTask *task;
+    ProxyAnswerRecord *record;
+    size_t length, offset;
+    guint i;
+
+    length = 0;
+    for(i=0; i<batch->len; i++) {
+        task = (const ReplyQueueTask*)g_ptr_array_index(batch, i);
+        length += proxy_subscribe_record_size(strlen(task->task) + 1);
+    }
+    if(length>proxy_subscribe_frame_capacity) {
+        proxy_subscribe_frame = (char*)realloc(proxy_subscribe_frame, length);
+        proxy_subscribe_frame_capacity = length;
+    }
+
+    offset = 0;
+    for(i=0; i<batch->len; i++) {
+        task = (const ReplyQueueTask*)g_ptr_array_index(batch, i);
+        record = (ProxyAnswerRecord*)(proxy_subscribe_frame + offset);
+        record->length = strlen(task->task) + 1;
+        record->remove_request = !task->multiple_respond;
+        memcpy(record + 1, task->task, record->length);
+        offset += proxy_subscribe_record_size(record->length);
+    }
+
+    return length;
+}
+
+static size_t proxy_subscribe_record_size(size_t text_length) {
+    return (sizeof(ProxyAnswerRecord) + text_length + ANSWER_RECORD_ALIGN - 1) & ~((size_t)ANSWER_RECORD_ALIGN - 1);
 }
 
-static enum ProxySubscribeState proxy_subscribe_exchange(const ReplyQueueTask *task) {
+static enum ProxySubscribeState proxy_subscribe_exchange(const GPtrArray *batch) {
+    const ReplyQueueTask *task;
+    const char *answer;
+    size_t length;
     char *answer_path;
     enum ProxySubscribeState state;
+    uint64_t start;
 
-    proxy_uuid_generate(proxy_subscribe_shm->aid);
-    answer_path = (char*)malloc(strlen(proxy_subscribe_shm->aid) + 2);
-    sprintf(answer_path, "/%s", proxy_subscribe_shm->aid);
+    if(batch->len==1) {
+        task = (const ReplyQueueTask*)g_ptr_array_index(batch, 0);
+        answer = task->task;
+        length = strlen(task->task) + 1;
+        proxy_subscribe_shm->remove_request = !task->multiple_respond;
+        proxy_subscribe_shm->answer_count = 0;
+    } else {
+        length = proxy_subscribe_batch_frame(batch);
+        answer = proxy_subscribe_frame;
+        proxy_subscribe_shm->remove_request = false;//per record
+        proxy_subscribe_shm->answer_count = batch->len;
+    }
+
+    SAWANG_PROBE(subscribe__exchange__start, batch->len, length);
+    answer_path = NULL;
+    if(!proxy_subscribe_answer_ring_write(answer, length)) {
+        proxy_uuid_generate(proxy_subscribe_shm->aid);
+        answer_path = (char*)malloc(strlen(proxy_subscribe_shm->aid) + 2);
+        sprintf(answer_path, "/%s", proxy_subscribe_shm->aid);
+        proxy_subscribe_shm->payload_buff_length = proxy_subscribe_create_answer(answer_path, answer, length);
+    }
 
     state = SUBSCRIBE_FAILED;
     do {
-        proxy_subscribe_shm->payload_buff_length = proxy_subscribe_create_answer(answer_path, task->task);
         if(proxy_subscribe_shm->payload_buff_length<1) {
             break;
         }
 
-        proxy_subscribe_shm->remove_request = !task->multiple_respond;
         proxy_subscribe_shm->state = SUBSCRIBE_ANSWER;
-        pthread_cond_signal(&proxy_subscribe_shm->dispatcher_wakeup);
+        wakeup_signal(&proxy_subscribe_dispatcher_wakeup);
 
-        if(pthread_cond_wait(&proxy_subscribe_shm->proxy_wakeup, &proxy_subscribe_shm->lock)==EOWNERDEAD){
+        start = metrics_now();
+        if(wakeup_wait(&proxy_subscribe_proxy_wakeup)==EOWNERDEAD){
             pthread_mutex_consistent(&proxy_subscribe_shm->lock);
             state = SUBSCRIBE_TERMINATION;
         } else {
             state = proxy_subscribe_shm->state;
+            metrics_observe(METRICS_SUBSCRIBE_HANDSHAKE, start);
+        }
+        if(answer_path!=NULL) {
+            shm_unlink(answer_path);
         }
-        shm_unlink(answer_path);
     } while(false);
 
-
-    free(answer_path);
+    if(answer_path!=NULL) {
+        free(answer_path);
+    } else {
+        //gonggo reads the answer in place before acknowledging, the slot is recycled right away
+        payload_ring_release(proxy_subscribe_ring, &proxy_subscribe_shm->answer_slot);
+    }
+    SAWANG_PROBE(subscribe__exchange__done, state);
     return state;
 }
 
-static size_t proxy_subscribe_create_answer(const char *path, const char *task)
+static bool proxy_subscribe_answer_ring_write(const char *answer, size_t length) {
+    char *data;
+
+    if(proxy_subscribe_ring==NULL) {
+        return false;
+    }
+
+    if(!payload_ring_reserve(proxy_subscribe_ring, length, &proxy_subscribe_shm->answer_slot)) {
+        return false;//too large or ring is full, fall back to aid shm
+    }
+    data = payload_ring_slot_data(proxy_subscribe_ring, &proxy_subscribe_shm->answer_slot);
+    memcpy(data, answer, length);
+    proxy_subscribe_shm->aid[0] = 0;
+    proxy_subscribe_shm->payload_buff_length = length;
+
+    return true;
+}
+
+static size_t proxy_subscribe_create_answer(const char *path, const char *answer, size_t length)
 {
     char buff[PROXYLOGBUFLEN], *shm_buff;
     int fd = -1;
@@ -278,7 +461,7 @@ static size_t proxy_subscribe_create_answer(const char *path, const char *task)
             buff_len = 0;
             break;
         }
-        buff_len = strlen(task) + 1;
+        buff_len = length;
         ftruncate(fd, buff_len);
 
         shm_buff = (char*)mmap(NULL, buff_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
@@ -290,7 +473,7 @@ static size_t proxy_subscribe_create_answer(const char *path, const char *task)
             break;
         }
 
-        strcpy(shm_buff, task);
+        memcpy(shm_buff, answer, length);
         munmap(shm_buff, buff_len);
     } while(false);
 
@@ -1,8 +1,13 @@
 #ifndef _PROXYSUBSCRIBE_H_
 #define _PROXYSUBSCRIBE_H_
 
-extern bool proxy_subscribe_context_init(void);
+#include <stdbool.h>
+
+#include "confvar.h"
+
+extern bool proxy_subscribe_context_init(const ConfVar *cv_head);
 extern void proxy_subscribe_shm_unlink_enable(void);
+extern void proxy_subscribe_wakeup_condvar(void);//before activation completes with a gonggo not knowing the wakeup fields
 extern void proxy_subscribe_context_destroy(void);
 extern void* proxy_subscribe(void *arg);
 extern void proxy_subscribe_waitfor_started(void);
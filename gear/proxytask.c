@@ -0,0 +1,65 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "define.h"
+#include "proxytask.h"
+#include "objectpool.h"
+
+ProxyTask *proxy_task_create(const char *service, cJSON *payload, TaskKey *key) {
+    ProxyTask *task;
+    size_t length;
+
+    if(service==NULL) {
+        service = "";
+    }
+    task = (ProxyTask*)object_pool_alloc(OBJECTPOOL_PROXY_TASK, sizeof(ProxyTask));
+    length = strlen(service) + 1;
+    if(length<=PROXYTASK_SERVICE_INLINE) {
+        memcpy(task->service, service, length);
+        task->arg.service = task->service;
+    } else {
+        task->arg.service = strdup(service);
+    }
+    task->arg.payload = payload;
+    task->owner = (uintptr_t)task ^ PROXYTASK_OWNER;
+    task->key = key;
+    trace_untraced(&task->trace);
+
+    return task;
+}
+
+//only for keys kept by the respond table, tasks from the channel are created already parsed
+ProxyTask *proxy_task_parse(TaskKey *key) {
+    cJSON *j, *item;
+    ProxyTask *task;
+
+    j = cJSON_ParseWithLength(key->text, key->length);
+    item = cJSON_GetObjectItem(j, SERVICE_SERVICE_KEY);
+    task = proxy_task_create(item!=NULL ? cJSON_GetStringValue(item) : NULL, 
+        cJSON_DetachItemFromObject(j, SERVICE_PAYLOAD_KEY), task_key_ref(key));
+    cJSON_Delete(j);
+
+    return task;
+}
+
+//arg is the first member of ProxyTask, the owner tag is checked before trusting the cast
+ProxyTask *proxy_task_from_arg(const ProxyReplyArg *arg) {
+    const ProxyTask *task;
+
+    task = (const ProxyTask*)arg;
+    return arg!=NULL && task->owner==((uintptr_t)task ^ PROXYTASK_OWNER) ? (ProxyTask*)task : NULL;
+}
+
+void proxy_task_destroy(ProxyTask *task) {
+    if(task!=NULL) {
+        if(task->arg.service!=task->service) {
+            free(task->arg.service);
+        }
+        if(task->arg.payload!=NULL) {
+            cJSON_Delete(task->arg.payload);
+        }
+        task_key_unref(task->key);
+        task->owner = 0;
+        object_pool_free(OBJECTPOOL_PROXY_TASK, task);
+    }
+}
\ No newline at end of file
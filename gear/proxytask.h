@@ -0,0 +1,29 @@
+#ifndef _PROXYTASK_H_
+#define _PROXYTASK_H_
+
+#include <stdint.h>
+#include <glib.h>
+
+#include "cJSON.h"
+#include "callback.h"
+#include "taskkey.h"
+#include "trace.h"
+
+#define PROXYTASK_SERVICE_INLINE 48//longer service names are allocated
+#define PROXYTASK_OWNER ((uintptr_t)0x5A3A4E47505854ULL)//mixed with the task address into ProxyTask.owner
+
+//a parsed task travels from channel to comm to reply without serializing it again
+typedef struct ProxyTask {
+    ProxyReplyArg arg;//must be the first member, callbacks receive &task->arg
+    uintptr_t owner;//tells &task->arg from a ProxyReplyArg the proxy built or copied
+    TaskKey *key;//respond table key
+    char service[PROXYTASK_SERVICE_INLINE];//arg.service points here when the name fits
+    TraceContext trace;//stages of the request that created the task
+} ProxyTask;
+
+extern ProxyTask *proxy_task_create(const char *service, cJSON *payload, TaskKey *key);//take over payload and the key reference
+extern ProxyTask *proxy_task_parse(TaskKey *key);
+extern ProxyTask *proxy_task_from_arg(const ProxyReplyArg *arg);//NULL when arg is not &task->arg of a live task
+extern void proxy_task_destroy(ProxyTask *task);
+
+#endif //_PROXYTASK_H_
\ No newline at end of file
@@ -1,84 +1,140 @@
+#include <stdio.h>
+#include <string.h>
+
 #include "define.h"
 #include "replyqueue.h"
-
-static GQueue *reply_queue = NULL;
-static pthread_mutex_t reply_queue_lock;
+#include "objectpool.h"
+#include "jsonarena.h"
+#include "metrics.h"
+#include "probe.h"
+
+//channel lanes, parse workers, proxycomm and backend threads produce, proxysubscribe consumes
+static MpscQueue reply_queue;
+static bool reply_queue_created = false;
+//failed tasks put back by the consumer, popped before reply_queue, touched by proxysubscribe only
+static ReplyQueueTask *reply_queue_front = NULL;
+static _Atomic int64_t reply_queue_front_depth = 0;//read by reply_queue_depth from any thread
 
 void reply_queue_create(void) {
-    pthread_mutexattr_t mtx_attr;
-
-    if(reply_queue==NULL) {
-        pthread_mutexattr_init(&mtx_attr);
-        pthread_mutexattr_setpshared(&mtx_attr, PTHREAD_PROCESS_PRIVATE);
-        pthread_mutexattr_settype(&mtx_attr, PTHREAD_MUTEX_NORMAL);
-        pthread_mutex_init(&reply_queue_lock, &mtx_attr);
-        pthread_mutexattr_destroy(&mtx_attr);
-
-        reply_queue = g_queue_new();
+    if(!reply_queue_created) {
+        mpsc_queue_init(&reply_queue);
+        reply_queue_front = NULL;
+        atomic_store_explicit(&reply_queue_front_depth, 0, memory_order_relaxed);
+        reply_queue_created = true;
     }
 }
 
 void reply_queue_destroy(void) {
-    if(reply_queue!=NULL) {
-        g_queue_free_full(reply_queue, (GDestroyNotify)reply_queue_task_destroy);
-        reply_queue = NULL;
-        pthread_mutex_destroy(&reply_queue_lock);
+    ReplyQueueTask *t;
+
+    if(reply_queue_created) {
+        while( (t = reply_queue_pop_head())!=NULL ) {
+            reply_queue_task_destroy(t);
+        }
+        reply_queue_created = false;
     }
 }
 
 void reply_queue_append(cJSON *rid, cJSON *headers, cJSON *payload, bool multiple_respond) {
-    cJSON *j;
-    ReplyQueueTask *t;
+    char *rid_text;
+
+    json_arena_begin();
+    rid_text = cJSON_PrintUnformatted(rid);
+    cJSON_Delete(rid);
+    reply_queue_append_rid_text(rid_text, headers, payload, multiple_respond, NULL);
+    cJSON_free(rid_text);
+    json_arena_end();
+}
 
-    t = (ReplyQueueTask*)malloc(sizeof(ReplyQueueTask));
+//the rid text comes from a cached subscriber snapshot, it is spliced in as is
+void reply_queue_append_rid_text(const char *rid, cJSON *headers, cJSON *payload, bool multiple_respond, const TraceContext *trace) {
+    ReplyQueueTask *t;
+    char *headers_text, *payload_text;
+    size_t length;
 
-    j = cJSON_CreateObject();
-    cJSON_AddItemToObject(j, SERVICE_RID_KEY, rid);
-    cJSON_AddItemToObject(j, SERVICE_HEADERS_KEY, headers);
+    json_arena_begin();//the printed texts die in this function
+    headers_text = cJSON_PrintUnformatted(headers);
+    cJSON_Delete(headers);
+    payload_text = NULL;
     if(payload!=NULL) {
-        cJSON_AddItemToObject(j, SERVICE_PAYLOAD_KEY, payload);
+        payload_text = cJSON_PrintUnformatted(payload);
+        cJSON_Delete(payload);
+    }
+
+    //same layout as cJSON_PrintUnformatted of {rid, headers, payload}
+    length = strlen(rid) + strlen(headers_text) + (payload_text!=NULL ? strlen(payload_text) : 0) 
+        + strlen(SERVICE_RID_KEY) + strlen(SERVICE_HEADERS_KEY) + strlen(SERVICE_PAYLOAD_KEY) + 16;
+    t = (ReplyQueueTask*)object_pool_alloc(OBJECTPOOL_REPLY_TASK, sizeof(ReplyQueueTask));
+    t->task = length<=REPLYQUEUE_INLINE_TEXT ? t->text : (char*)malloc(length);
+    if(payload_text!=NULL) {
+        snprintf(t->task, length, "{\"%s\":%s,\"%s\":%s,\"%s\":%s}", 
+            SERVICE_RID_KEY, rid, SERVICE_HEADERS_KEY, headers_text, SERVICE_PAYLOAD_KEY, payload_text);
+    } else {
+        snprintf(t->task, length, "{\"%s\":%s,\"%s\":%s}", SERVICE_RID_KEY, rid, SERVICE_HEADERS_KEY, headers_text);
     }
-    t->task = cJSON_PrintUnformatted(j);
-    cJSON_Delete(j);
+    cJSON_free(headers_text);
+    cJSON_free(payload_text);
+    json_arena_end();
     t->multiple_respond = multiple_respond;
+    if(trace!=NULL) {
+        t->trace = *trace;
+        trace_mark(&t->trace);//reply queue wait starts
+    } else {
+        trace_untraced(&t->trace);
+    }
 
-    pthread_mutex_lock(&reply_queue_lock);
-    g_queue_push_tail(reply_queue, t);
-    pthread_mutex_unlock(&reply_queue_lock);
+    mpsc_queue_push(&reply_queue, &t->node);
+    metrics_add(METRICS_REPLY_QUEUE_PUSHED, 1);
+    SAWANG_PROBE(reply__queue__push, rid, length, reply_queue_depth());
 }
 
 void reply_queue_append_invalid_status(const char *rid, int status) {
     cJSON *headers;
 
+    json_arena_begin();
     headers = cJSON_CreateObject();
     cJSON_AddNumberToObject(headers, SERVICE_STATUS_KEY, status);
     reply_queue_append(cJSON_CreateString(rid), headers, NULL, false);
+    json_arena_end();
 }
 
 ReplyQueueTask *reply_queue_pop_head(void) {
     ReplyQueueTask *t;
+    MpscNode *node;
 
-    pthread_mutex_lock(&reply_queue_lock);
-    t = (ReplyQueueTask*)g_queue_pop_head(reply_queue);
-    pthread_mutex_unlock(&reply_queue_lock);
+    if( (t = reply_queue_front)!=NULL ) {
+        reply_queue_front = (ReplyQueueTask*)atomic_load_explicit(&t->node.next, memory_order_relaxed);
+        atomic_fetch_sub_explicit(&reply_queue_front_depth, 1, memory_order_relaxed);
+    } else if( (node = mpsc_queue_pop(&reply_queue))!=NULL ) {
+        t = MPSC_CONTAINER(node, ReplyQueueTask);
+    }
+    if(t!=NULL) {
+        metrics_add(METRICS_REPLY_QUEUE_POPPED, 1);
+    }
     return t;
 }
 
+int64_t reply_queue_depth(void) {
+    return mpsc_queue_depth(&reply_queue) + atomic_load_explicit(&reply_queue_front_depth, memory_order_relaxed);
+}
+
+//consumer only, the node link is free once a task is popped so the front list reuses it
 void reply_queue_push_head(GQueue *src) {
     ReplyQueueTask *t;
 
-    pthread_mutex_lock(&reply_queue_lock);
     while( (t = g_queue_pop_tail(src))!=NULL ) {
-        g_queue_push_head(reply_queue, t);
+        atomic_store_explicit(&t->node.next, (MpscNode*)reply_queue_front, memory_order_relaxed);
+        reply_queue_front = t;
+        atomic_fetch_add_explicit(&reply_queue_front_depth, 1, memory_order_relaxed);
+        metrics_add(METRICS_REPLY_QUEUE_POPPED, -1);//queued again
     }   
-    pthread_mutex_unlock(&reply_queue_lock);
 }
 
 void reply_queue_task_destroy(ReplyQueueTask* task) {
     if(task!=NULL) {
-        if(task->task!=NULL) {
+        if(task->task!=NULL && task->task!=task->text) {
             free(task->task);
         }
-        free(task);
+        object_pool_free(OBJECTPOOL_REPLY_TASK, task);
     }
 }
\ No newline at end of file
@@ -2,20 +2,30 @@
 #define _REPLYQUEUE_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <glib.h>
 
 #include "cJSON.h"
+#include "mpscqueue.h"
+#include "trace.h"
+
+#define REPLYQUEUE_INLINE_TEXT 480//longer replies are allocated
 
 typedef struct ReplyQueueTask {
-    char *task;
+    MpscNode node;
+    char *task;//points to text unless the reply is longer than REPLYQUEUE_INLINE_TEXT
     bool multiple_respond;
+    TraceContext trace;
+    char text[REPLYQUEUE_INLINE_TEXT];
 } ReplyQueueTask;
 
 extern void reply_queue_create(void);
 extern void reply_queue_destroy(void);
 extern void reply_queue_append(cJSON *rid, cJSON *headers, cJSON *payload, bool multiple_respond);
+extern void reply_queue_append_rid_text(const char *rid, cJSON *headers, cJSON *payload, bool multiple_respond, const TraceContext *trace);//rid is serialized json, trace may be NULL
 extern void reply_queue_append_invalid_status(const char *rid, int status);
 extern ReplyQueueTask *reply_queue_pop_head(void);
+extern int64_t reply_queue_depth(void);//kept by the queue, whether metrics is enabled or not
 extern void reply_queue_push_head(GQueue *src);
 extern void reply_queue_task_destroy(ReplyQueueTask* task);
 
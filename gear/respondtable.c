@@ -1,39 +1,57 @@
 #include "respondtable.h"
 #include "util.h"
+#include "log.h"
+#include "ridset.h"
+#include "metrics.h"
+#include "probe.h"
 
 #ifdef GLIBSHIM
 #include "glibshim.h"
 #endif //GLIBSHIM
 
-static bool respond_table_has_lock = false;
-static pthread_mutex_t respond_table_lock;
+#define RESPONDTABLE_SHARDS 16 //power of 2
+
+typedef struct RespondTableShard {
+    pthread_mutex_t lock;
+    GHashTable *singleshot;
+    GHashTable *multirespond;
+} RespondTableShard;
 
 static bool respond_table_has_table = false;
-static GHashTable *singleshot_table = NULL;
-static GHashTable *multirespond_table = NULL;
+//task_key to RidSnapshot, sharded by task_key hash
+static RespondTableShard respond_table_tasks[RESPONDTABLE_SHARDS];
+//reverse index, map binary request_uuid to the task_key holding it, sharded by request_uuid
+//lock order is task shard then request shard, a request shard lock is never held while taking a task shard lock
+static RespondTableShard respond_table_requests[RESPONDTABLE_SHARDS];
 
-//map request-uuid to SingleShotTableContext
-static GHashTable *respond_table_which(enum RespondTableType which);
-static void respond_table_value_destroy(GPtrArray* arr);
-//return true on new entry
-static bool respond_table_set_do(GHashTable *table, const char *task_key, const char* request_uuid);
-static bool respond_table_drop_do(GHashTable *table, const char *task_key, const char* request_uuid, guint *remaining);
+//function
+static RespondTableShard *respond_table_task_shard(const TaskKey *task_key);
+static RespondTableShard *respond_table_request_shard(const uuid_t rid);
+static GHashTable *respond_table_which(RespondTableShard *shard, enum RespondTableType which);
+static void respond_table_shard_init(RespondTableShard *shard, GHashFunc hash_func, GEqualFunc key_equal_func, 
+    GDestroyNotify key_destroy_func, GDestroyNotify value_destroy_func);
+static void respond_table_shard_destroy(RespondTableShard *shard);
+static void respond_table_value_destroy(RidSnapshot *snapshot);
+static RidSet *respond_table_edit(GHashTable *table, TaskKey *task_key, RidSnapshot *snapshot);//copy a shared snapshot before writing
+//return true on new entry, new_task tells whether task_key had no entry before
+static bool respond_table_set_do(GHashTable *table, enum RespondTableType which, TaskKey *task_key, const uuid_t rid, bool *new_task);
+static bool respond_table_drop_do(GHashTable *table, enum RespondTableType which, const TaskKey *task_key, const uuid_t rid, guint *remaining);
+static void respond_table_index(enum RespondTableType which, TaskKey *task_key, const uuid_t rid);
+static TaskKey *respond_table_index_lookup(enum RespondTableType which, const uuid_t rid);//return a new reference
+static void respond_table_unindex(enum RespondTableType which, const TaskKey *task_key, const RidSet *set);
+static void respond_table_unindex_request(enum RespondTableType which, const TaskKey *task_key, const uuid_t rid);
+static void respond_table_metrics(enum RespondTableType which, int64_t tasks, int64_t requests);
 
 void respond_table_create(void) {
-    pthread_mutexattr_t mtx_attr;
-
-    if(!respond_table_has_lock) {
-        pthread_mutexattr_init(&mtx_attr);
-        pthread_mutexattr_setpshared(&mtx_attr, PTHREAD_PROCESS_PRIVATE);
-        pthread_mutexattr_settype(&mtx_attr, PTHREAD_MUTEX_NORMAL);
-        pthread_mutex_init(&respond_table_lock, &mtx_attr);
-        pthread_mutexattr_destroy(&mtx_attr);
-        respond_table_has_lock = true;
-    }
+    guint i;
 
     if(!respond_table_has_table) {
-        singleshot_table = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)free, (GDestroyNotify)respond_table_value_destroy);
-        multirespond_table = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)free, (GDestroyNotify)respond_table_value_destroy);
+        for(i=0; i<RESPONDTABLE_SHARDS; i++) {
+            respond_table_shard_init(&respond_table_tasks[i], (GHashFunc)task_key_hash, (GEqualFunc)task_key_equal, 
+                (GDestroyNotify)task_key_unref, (GDestroyNotify)respond_table_value_destroy);
+            respond_table_shard_init(&respond_table_requests[i], (GHashFunc)rid_hash, (GEqualFunc)rid_equal, 
+                (GDestroyNotify)free, (GDestroyNotify)task_key_unref);
+        }
         respond_table_has_table = true;
     }
 }
@@ -43,123 +61,187 @@ char *respond_table_request_uuid_dup(const char *s, gpointer data) {
 }
 
 void respond_table_destroy(void) {
+    guint i;
+
     if(respond_table_has_table) {
-        g_hash_table_destroy(singleshot_table);   
-        singleshot_table = NULL;
-        g_hash_table_destroy(multirespond_table);
-        multirespond_table = NULL;
+        for(i=0; i<RESPONDTABLE_SHARDS; i++) {
+            respond_table_shard_destroy(&respond_table_tasks[i]);
+            respond_table_shard_destroy(&respond_table_requests[i]);
+        }
         respond_table_has_table = false;
     }
-    if(respond_table_has_lock) {
-        pthread_mutex_destroy(&respond_table_lock);
-        respond_table_has_lock = false;
-    }
 }
 
-//return true on new entry
-bool respond_table_set(enum RespondTableType which, const char *task_key, const char* request_uuid) {
+//return true on new entry, new_task is set when the request starts a task instead of joining a running one
+bool respond_table_set(enum RespondTableType which, TaskKey *task_key, const char* request_uuid, bool *new_task) {
+    RespondTableShard *shard;
     GHashTable *table;
-    bool new_entry = false;
+    bool new_entry = false, created = false;
+    uuid_t rid;
 
-    if((table = respond_table_which(which))!=NULL) {
-        pthread_mutex_lock(&respond_table_lock);
-        new_entry = respond_table_set_do(table, task_key, request_uuid);
-        pthread_mutex_unlock(&respond_table_lock);
+    if(new_task!=NULL) {
+        *new_task = false;
     }
+    if(!rid_parse(request_uuid, rid)) {
+        proxy_log("ERROR", "respond table rejects malformed request id %s", request_uuid!=NULL ? request_uuid : "");
+        return false;
+    }
+    shard = respond_table_task_shard(task_key);
+    if((table = respond_table_which(shard, which))!=NULL) {
+        pthread_mutex_lock(&shard->lock);
+        new_entry = respond_table_set_do(table, which, task_key, rid, &created);
+        pthread_mutex_unlock(&shard->lock);
+    }
+    if(new_task!=NULL) {
+        *new_task = created;
+    }
+    SAWANG_PROBE(respond__table__set, which, request_uuid, new_entry);
     return new_entry;
 }
 
-bool respond_table_drop(enum RespondTableType which, const char *task_key, const char* request_uuid, guint *remaining) {
+bool respond_table_drop(enum RespondTableType which, const TaskKey *task_key, const char* request_uuid, guint *remaining) {
+    RespondTableShard *shard;
     GHashTable *table;
     bool exists = false;
+    uuid_t rid;
 
-    if((table = respond_table_which(which))!=NULL){
-        pthread_mutex_lock(&respond_table_lock);
-        exists = respond_table_drop_do(table, task_key, request_uuid, remaining);
-        pthread_mutex_unlock(&respond_table_lock);
+    if(remaining!=NULL) {
+        *remaining = 0;
+    }
+    if(!rid_parse(request_uuid, rid)) {
+        return false;
+    }
+    shard = respond_table_task_shard(task_key);
+    if((table = respond_table_which(shard, which))!=NULL){
+        pthread_mutex_lock(&shard->lock);
+        exists = respond_table_drop_do(table, which, task_key, rid, remaining);
+        pthread_mutex_unlock(&shard->lock);
     }
+    SAWANG_PROBE(respond__table__drop, which, request_uuid, exists);
     return exists;
 }
 
-GPtrArray* respond_table_request_dup(enum RespondTableType which, const char *task_key) {
+RidSnapshot* respond_table_snapshot(enum RespondTableType which, const TaskKey *task_key) {
+    RespondTableShard *shard;
     GHashTable *table;
-    GPtrArray *arr, *ret = NULL;
+    RidSnapshot *snapshot = NULL;
 
-    if((table = respond_table_which(which))!=NULL) {
-        pthread_mutex_lock(&respond_table_lock);
-        arr = (GPtrArray*)g_hash_table_lookup(table, task_key);
-        ret = arr!=NULL ? g_ptr_array_copy(arr, (GCopyFunc)str_dup, NULL) : NULL;
-        pthread_mutex_unlock(&respond_table_lock);
+    shard = respond_table_task_shard(task_key);
+    if((table = respond_table_which(shard, which))!=NULL) {
+        pthread_mutex_lock(&shard->lock);
+        if( (snapshot = (RidSnapshot*)g_hash_table_lookup(table, task_key))!=NULL ) {
+            rid_snapshot_ref(snapshot);
+        }
+        pthread_mutex_unlock(&shard->lock);
     }
-    return ret;
+    return snapshot;
+}
+
+TaskKey *respond_table_dup_task_key(enum RespondTableType which, const char* request_uuid) {
+    uuid_t rid;
+
+    return rid_parse(request_uuid, rid) ? respond_table_index_lookup(which, rid) : NULL;
 }
 
-char *respond_table_dup_task_key(enum RespondTableType which, const char* request_uuid) {
-    char *task_key = NULL;
+//return the task keys left without request as new references
+GPtrArray *respond_table_drop_requests(enum RespondTableType which, const char **request_uuids, guint count) {
+    RespondTableShard *shard;
     GHashTable *table;
-    GHashTableIter iter;
-    char *tk;
-    GPtrArray* arr;
-
-    if((table = respond_table_which(which))!=NULL) {
-        pthread_mutex_lock(&respond_table_lock);
-        g_hash_table_iter_init(&iter, table);
-        while (g_hash_table_iter_next(&iter, (gpointer*)&tk, (gpointer*)&arr)) {
-            if(g_ptr_array_find_with_equal_func(arr, request_uuid, (GEqualFunc)str_equal, NULL)) {
-                task_key = strdup(tk);
-                break;
-            }
+    GPtrArray *emptied;
+    TaskKey *task_key;
+    guint i, remaining;
+    uuid_t rid;
+
+    emptied = g_ptr_array_new_full(0, (GDestroyNotify)task_key_unref);
+    for(i=0; i<count; i++) {
+        if(!rid_parse(request_uuids[i], rid) || (task_key = respond_table_index_lookup(which, rid))==NULL) {
+            continue;
+        }
+        shard = respond_table_task_shard(task_key);
+        if((table = respond_table_which(shard, which))==NULL) {
+            task_key_unref(task_key);
+            continue;
         }
-        pthread_mutex_unlock(&respond_table_lock);
+        pthread_mutex_lock(&shard->lock);
+        if(respond_table_drop_do(table, which, task_key, rid, &remaining) && remaining<1) {
+            g_ptr_array_add(emptied, task_key);
+        } else {
+            task_key_unref(task_key);
+        }
+        pthread_mutex_unlock(&shard->lock);
     }
-    return task_key;
+    SAWANG_PROBE(respond__table__drop__requests, which, count, emptied->len);
+    return emptied;
 }
 
-void respond_table_remove(enum RespondTableType which, const char *task_key) {
+void respond_table_remove(enum RespondTableType which, const TaskKey *task_key) {
+    RespondTableShard *shard;
     GHashTable *table;
+    RidSnapshot *snapshot;
 
-    if((table = respond_table_which(which))!=NULL) {
-        pthread_mutex_lock(&respond_table_lock);
-        g_hash_table_remove(table, task_key);
-        pthread_mutex_unlock(&respond_table_lock);
+    shard = respond_table_task_shard(task_key);
+    if((table = respond_table_which(shard, which))!=NULL) {
+        pthread_mutex_lock(&shard->lock);
+        snapshot = (RidSnapshot*)g_hash_table_lookup(table, task_key);
+        if(snapshot!=NULL) {
+            respond_table_unindex(which, task_key, snapshot->set);
+            respond_table_metrics(which, -1, -(int64_t)snapshot->set->count);
+            g_hash_table_remove(table, task_key);
+        }
+        pthread_mutex_unlock(&shard->lock);
     }
 }
 
-bool respond_table_task_exists(enum RespondTableType which, const char *task_key) {
+bool respond_table_task_exists(enum RespondTableType which, const TaskKey *task_key) {
+    RespondTableShard *shard;
     GHashTable *table;
     bool exists = false;
 
-    if((table = respond_table_which(which))!=NULL) {
-        pthread_mutex_lock(&respond_table_lock);
+    shard = respond_table_task_shard(task_key);
+    if((table = respond_table_which(shard, which))!=NULL) {
+        pthread_mutex_lock(&shard->lock);
         exists = g_hash_table_lookup(table, task_key)!=NULL;
-        pthread_mutex_unlock(&respond_table_lock);
+        pthread_mutex_unlock(&shard->lock);
     }
     return exists;
 }
 
-bool respond_table_request_exists(enum RespondTableType which, const char *task_key, const char *request_uuid) {
+bool respond_table_request_exists(enum RespondTableType which, const TaskKey *task_key, const char *request_uuid) {
+    RespondTableShard *shard;
     GHashTable *table;
-    GPtrArray *arr;
+    RidSnapshot *snapshot;
     bool exists = false;
+    uuid_t rid;
 
-    if((table = respond_table_which(which))!=NULL) {
-        pthread_mutex_lock(&respond_table_lock);
-        if( (arr = (GPtrArray*)g_hash_table_lookup(table, task_key))!=NULL ) {
-            exists = g_ptr_array_find_with_equal_func(arr, request_uuid, (GEqualFunc)str_equal, NULL);
+    shard = respond_table_task_shard(task_key);
+    if(rid_parse(request_uuid, rid) && (table = respond_table_which(shard, which))!=NULL) {
+        pthread_mutex_lock(&shard->lock);
+        if( (snapshot = (RidSnapshot*)g_hash_table_lookup(table, task_key))!=NULL ) {
+            exists = rid_set_contains(snapshot->set, rid);
         }
-        pthread_mutex_unlock(&respond_table_lock);
+        pthread_mutex_unlock(&shard->lock);
     }
     return exists;
 }
 
-static GHashTable *respond_table_which(enum RespondTableType which) {
+//upper hash bits pick the shard, GHashTable buckets use the lower ones
+static RespondTableShard *respond_table_task_shard(const TaskKey *task_key) {
+    return &respond_table_tasks[(task_key->hash >> 32) & (RESPONDTABLE_SHARDS - 1)];
+}
+
+//top bits of the mixed rid, rid_hash hands its low bits to the buckets
+static RespondTableShard *respond_table_request_shard(const uuid_t rid) {
+    return &respond_table_requests[(rid_mix(rid) >> 56) & (RESPONDTABLE_SHARDS - 1)];
+}
+
+static GHashTable *respond_table_which(RespondTableShard *shard, enum RespondTableType which) {
     GHashTable *t;
     switch(which) {
         case RESPONDTABLE_SINGLESHOT:
-            t = singleshot_table;
+            t = shard->singleshot;
             break;
         case RESPONDTABLE_MULTIRESPOND:
-            t = multirespond_table;
+            t = shard->multirespond;
             break;
         default:
             t = NULL;
@@ -168,47 +250,142 @@ static GHashTable *respond_table_which(enum RespondTableType which) {
     return t;
 }
 
-static void respond_table_value_destroy(GPtrArray* arr) {
-    if(arr!=NULL) {
-        g_ptr_array_free(arr, true);
+static void respond_table_shard_init(RespondTableShard *shard, GHashFunc hash_func, GEqualFunc key_equal_func, 
+    GDestroyNotify key_destroy_func, GDestroyNotify value_destroy_func) 
+{
+    pthread_mutexattr_t mtx_attr;
+
+    pthread_mutexattr_init(&mtx_attr);
+    pthread_mutexattr_setpshared(&mtx_attr, PTHREAD_PROCESS_PRIVATE);
+    pthread_mutexattr_settype(&mtx_attr, PTHREAD_MUTEX_NORMAL);
+    pthread_mutex_init(&shard->lock, &mtx_attr);
+    pthread_mutexattr_destroy(&mtx_attr);
+
+    shard->singleshot = g_hash_table_new_full(hash_func, key_equal_func, key_destroy_func, value_destroy_func);
+    shard->multirespond = g_hash_table_new_full(hash_func, key_equal_func, key_destroy_func, value_destroy_func);
+}
+
+static void respond_table_shard_destroy(RespondTableShard *shard) {
+    g_hash_table_destroy(shard->singleshot);
+    shard->singleshot = NULL;
+    g_hash_table_destroy(shard->multirespond);
+    shard->multirespond = NULL;
+    pthread_mutex_destroy(&shard->lock);
+}
+
+static void respond_table_value_destroy(RidSnapshot *snapshot) {
+    rid_snapshot_unref(snapshot);
+}
+
+//readers keep their snapshot untouched, a writer swaps in a private copy
+static RidSet *respond_table_edit(GHashTable *table, TaskKey *task_key, RidSnapshot *snapshot) {
+    if(snapshot==NULL || rid_snapshot_shared(snapshot)) {
+        snapshot = rid_snapshot_new(snapshot!=NULL ? rid_set_copy(snapshot->set) : rid_set_new());
+        g_hash_table_replace(table, task_key_ref(task_key), snapshot);
     }
+    return rid_snapshot_edit(snapshot);
 }
 
-static bool respond_table_set_do(GHashTable *table, const char *task_key, const char* request_uuid) {
-    GPtrArray* arr;
-    bool new_entry = true;
+//caller holds the task shard lock
+static bool respond_table_set_do(GHashTable *table, enum RespondTableType which, TaskKey *task_key, const uuid_t rid, bool *new_task) {
+    RidSnapshot *snapshot;
+    bool new_entry;
 
-    arr = (GPtrArray*)g_hash_table_lookup(table, task_key);
-    if(arr==NULL) {
-        arr = g_ptr_array_new_full(1, (GDestroyNotify)free);
-        g_hash_table_insert(table, strdup(task_key), arr); 
-    } else {
-        new_entry = !g_ptr_array_find_with_equal_func(arr, request_uuid, (GEqualFunc)str_equal, NULL);
+    snapshot = (RidSnapshot*)g_hash_table_lookup(table, task_key);
+    *new_task = snapshot==NULL;
+    if(snapshot!=NULL && rid_set_contains(snapshot->set, rid)) {
+        return false;
     }
+    new_entry = rid_set_add(respond_table_edit(table, task_key, snapshot), rid);
     if(new_entry) {
-        g_ptr_array_add(arr, strdup(request_uuid));
+        respond_table_index(which, task_key, rid);
+        respond_table_metrics(which, snapshot==NULL ? 1 : 0, 1);
     }
     return new_entry;
 }
 
-static bool respond_table_drop_do(GHashTable *table, const char *task_key, const char* request_uuid, guint *remaining) {
-    GPtrArray* arr;
-    guint idx, count;
+//caller holds the task shard lock
+static bool respond_table_drop_do(GHashTable *table, enum RespondTableType which, const TaskKey *task_key, const uuid_t rid, guint *remaining) {
+    RidSnapshot *snapshot;
+    RidSet *set;
     bool exists = false;
 
     if(remaining!=NULL) {
         *remaining = 0;
     }
-    arr = (GPtrArray*)g_hash_table_lookup(table, task_key);
-    if( (exists = g_ptr_array_find_with_equal_func(arr, request_uuid, (GEqualFunc)str_equal, &idx)) ) {
-        g_ptr_array_remove_index(arr, idx);
-        count = arr->len;
+    snapshot = (RidSnapshot*)g_hash_table_lookup(table, task_key);
+    if( snapshot!=NULL && rid_set_contains(snapshot->set, rid) ) {
+        set = respond_table_edit(table, (TaskKey*)task_key, snapshot);
+        exists = rid_set_remove(set, rid);
+        respond_table_unindex_request(which, task_key, rid);
         if(remaining!=NULL) {
-            *remaining = count;
+            *remaining = set->count;
         }                
-        if(count<1) {
+        respond_table_metrics(which, set->count<1 ? -1 : 0, -1);
+        if(set->count<1) {
             g_hash_table_remove(table, task_key);
         }
     }
     return exists;
+}
+
+static void respond_table_index(enum RespondTableType which, TaskKey *task_key, const uuid_t rid) {
+    RespondTableShard *shard;
+
+    shard = respond_table_request_shard(rid);
+    pthread_mutex_lock(&shard->lock);
+    g_hash_table_insert(respond_table_which(shard, which), rid_dup(rid), task_key_ref(task_key));
+    pthread_mutex_unlock(&shard->lock);
+}
+
+static TaskKey *respond_table_index_lookup(enum RespondTableType which, const uuid_t rid) {
+    RespondTableShard *shard;
+    GHashTable *index;
+    TaskKey *task_key = NULL;
+
+    shard = respond_table_request_shard(rid);
+    if((index = respond_table_which(shard, which))!=NULL) {
+        pthread_mutex_lock(&shard->lock);
+        task_key = (TaskKey*)g_hash_table_lookup(index, rid);
+        if(task_key!=NULL) {
+            task_key_ref(task_key);
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+    return task_key;
+}
+
+static void respond_table_unindex(enum RespondTableType which, const TaskKey *task_key, const RidSet *set) {
+    guint cursor = 0;
+    uuid_t rid;
+
+    while(set!=NULL && rid_set_next(set, &cursor, rid)) {
+        respond_table_unindex_request(which, task_key, rid);
+    }
+}
+
+//a request id reused under another task_key keeps its newer index entry
+static void respond_table_unindex_request(enum RespondTableType which, const TaskKey *task_key, const uuid_t rid) {
+    RespondTableShard *shard;
+    GHashTable *index;
+    const TaskKey *indexed;
+
+    shard = respond_table_request_shard(rid);
+    index = respond_table_which(shard, which);
+    pthread_mutex_lock(&shard->lock);
+    indexed = (const TaskKey*)g_hash_table_lookup(index, rid);
+    if(indexed!=NULL && task_key_equal(indexed, task_key)) {
+        g_hash_table_remove(index, rid);
+    }
+    pthread_mutex_unlock(&shard->lock);
+}
+
+static void respond_table_metrics(enum RespondTableType which, int64_t tasks, int64_t requests) {
+    if(which==RESPONDTABLE_SINGLESHOT) {
+        metrics_add(METRICS_SINGLESHOT_TASKS, tasks);
+        metrics_add(METRICS_SINGLESHOT_REQUESTS, requests);
+    } else {
+        metrics_add(METRICS_MULTIRESPOND_TASKS, tasks);
+        metrics_add(METRICS_MULTIRESPOND_REQUESTS, requests);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,261 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "ridset.h"
+#include "define.h"
+
+#define RIDSET_MIN_CAPACITY 4
+#define RIDSET_TEXT_ITEM (UUIDBUFLEN + 2)//quoted uuid with its separator
+
+//function
+static guint rid_set_slot(const RidSet *set, const uuid_t rid, bool *found);
+static void rid_set_grow(RidSet *set);
+static char *rid_snapshot_serialize(const RidSet *set);
+
+//rids are written back with uuid_unparse_lower, so only that spelling is accepted and gonggo gets its rid back as sent
+bool rid_parse(const char *text, uuid_t rid) {
+    size_t i;
+
+    if(text==NULL || strlen(text)!=UUIDBUFLEN - 1) {
+        return false;
+    }
+    for(i=0; i<UUIDBUFLEN - 1; i++) {
+        if(text[i]>='A' && text[i]<='F') {
+            return false;
+        }
+    }
+    return uuid_parse(text, rid)==0 && !uuid_is_null(rid);
+}
+
+RidSet *rid_set_new(void) {
+    RidSet *set;
+
+    set = (RidSet*)malloc(sizeof(RidSet));
+    set->count = 0;
+    set->capacity = RIDSET_MIN_CAPACITY;
+    set->slots = (uuid_t*)calloc(set->capacity, sizeof(uuid_t));
+
+    return set;
+}
+
+RidSet *rid_set_copy(const RidSet *set) {
+    RidSet *copy;
+
+    copy = (RidSet*)malloc(sizeof(RidSet));
+    copy->count = set->count;
+    copy->capacity = set->capacity;
+    copy->slots = (uuid_t*)malloc(set->capacity * sizeof(uuid_t));
+    memcpy(copy->slots, set->slots, set->capacity * sizeof(uuid_t));
+
+    return copy;
+}
+
+void rid_set_free(RidSet *set) {
+    if(set!=NULL) {
+        free(set->slots);
+        free(set);
+    }
+}
+
+bool rid_set_add(RidSet *set, const uuid_t rid) {
+    guint slot;
+    bool found;
+
+    if((set->count + 1) * 4 > set->capacity * 3) {
+        rid_set_grow(set);
+    }
+    slot = rid_set_slot(set, rid, &found);
+    if(found) {
+        return false;
+    }
+    uuid_copy(set->slots[slot], rid);
+    set->count++;
+    return true;
+}
+
+//backward shift deletion keeps probe chains intact without tombstones
+bool rid_set_remove(RidSet *set, const uuid_t rid) {
+    guint hole, next, home, mask;
+    bool found;
+
+    hole = rid_set_slot(set, rid, &found);
+    if(!found) {
+        return false;
+    }
+
+    mask = set->capacity - 1;
+    next = hole;
+    while(true) {
+        next = (next + 1) & mask;
+        if(uuid_is_null(set->slots[next])) {
+            break;
+        }
+        home = rid_hash(set->slots[next]) & mask;
+        //move the entry back when its home is not cyclically inside (hole, next]
+        if(((next - home) & mask) >= ((next - hole) & mask)) {
+            uuid_copy(set->slots[hole], set->slots[next]);
+            hole = next;
+        }
+    }
+    uuid_clear(set->slots[hole]);
+    set->count--;
+    return true;
+}
+
+bool rid_set_contains(const RidSet *set, const uuid_t rid) {
+    bool found;
+
+    rid_set_slot(set, rid, &found);
+    return found;
+}
+
+bool rid_set_next(const RidSet *set, guint *cursor, uuid_t rid) {
+    while(*cursor < set->capacity) {
+        if(!uuid_is_null(set->slots[*cursor])) {
+            uuid_copy(rid, set->slots[(*cursor)++]);
+            return true;
+        }
+        (*cursor)++;
+    }
+    return false;
+}
+
+RidSnapshot *rid_snapshot_new(RidSet *set) {
+    RidSnapshot *snapshot;
+
+    snapshot = (RidSnapshot*)malloc(sizeof(RidSnapshot));
+    snapshot->ref = 1;
+    snapshot->set = set;
+    snapshot->text = NULL;
+
+    return snapshot;
+}
+
+RidSnapshot *rid_snapshot_ref(RidSnapshot *snapshot) {
+    g_atomic_int_inc(&snapshot->ref);
+    return snapshot;
+}
+
+void rid_snapshot_unref(RidSnapshot *snapshot) {
+    if(snapshot!=NULL && g_atomic_int_dec_and_test(&snapshot->ref)) {
+        rid_set_free(snapshot->set);
+        free(snapshot->text);
+        free(snapshot);
+    }
+}
+
+//new references are only taken by the owner of the last one, so a stale read just copies once too often
+bool rid_snapshot_shared(const RidSnapshot *snapshot) {
+    return g_atomic_int_get(&snapshot->ref) > 1;
+}
+
+RidSet *rid_snapshot_edit(RidSnapshot *snapshot) {
+    free(snapshot->text);
+    snapshot->text = NULL;
+    return snapshot->set;
+}
+
+//holders may race to build the text, the first one published wins
+const char *rid_snapshot_text(RidSnapshot *snapshot) {
+    char *text;
+
+    text = (char*)g_atomic_pointer_get(&snapshot->text);
+    if(text==NULL) {
+        text = rid_snapshot_serialize(snapshot->set);
+        if(!g_atomic_pointer_compare_and_exchange(&snapshot->text, NULL, text)) {
+            free(text);
+            text = (char*)g_atomic_pointer_get(&snapshot->text);
+        }
+    }
+    return text;
+}
+
+unsigned char *rid_dup(const uuid_t rid) {
+    unsigned char *copy;
+
+    copy = (unsigned char*)malloc(sizeof(uuid_t));
+    uuid_copy(copy, rid);
+    return copy;
+}
+
+//every byte counts, time based uuids keep the node in the last bytes and move the clock slowly in the first ones
+guint64 rid_mix(const unsigned char *rid) {
+    guint64 lo, hi;
+
+    memcpy(&lo, rid, sizeof(guint64));
+    memcpy(&hi, rid + sizeof(guint64), sizeof(guint64));
+    return (lo ^ hi) * 0x9E3779B97F4A7C15ULL;
+}
+
+//the upper half of the mix, its low bits pick the slot
+guint rid_hash(const unsigned char *rid) {
+    return (guint)(rid_mix(rid) >> 32);
+}
+
+gboolean rid_equal(const unsigned char *rid1, const unsigned char *rid2) {
+    return memcmp(rid1, rid2, sizeof(uuid_t))==0;
+}
+
+//return the slot holding rid, or the empty slot where it belongs
+static guint rid_set_slot(const RidSet *set, const uuid_t rid, bool *found) {
+    guint slot, mask;
+
+    mask = set->capacity - 1;
+    slot = rid_hash(rid) & mask;
+    while(!uuid_is_null(set->slots[slot])) {
+        if(memcmp(set->slots[slot], rid, sizeof(uuid_t))==0) {
+            *found = true;
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+    *found = false;
+    return slot;
+}
+
+static void rid_set_grow(RidSet *set) {
+    uuid_t *old_slots;
+    guint old_capacity, i, slot;
+    bool found;
+
+    old_slots = set->slots;
+    old_capacity = set->capacity;
+    set->capacity = old_capacity * 2;
+    set->slots = (uuid_t*)calloc(set->capacity, sizeof(uuid_t));
+    for(i=0; i<old_capacity; i++) {
+        if(!uuid_is_null(old_slots[i])) {
+            slot = rid_set_slot(set, old_slots[i], &found);
+            uuid_copy(set->slots[slot], old_slots[i]);
+        }
+    }
+    free(old_slots);
+}
+
+//same text cJSON_PrintUnformatted gives for the string or the array of strings
+static char *rid_snapshot_serialize(const RidSet *set) {
+    char *text, *p;
+    guint cursor;
+    uuid_t rid;
+
+    text = (char*)malloc(set->count * RIDSET_TEXT_ITEM + 3);
+    p = text;
+    if(set->count!=1) {
+        *p++ = '[';
+    }
+    cursor = 0;
+    while(rid_set_next(set, &cursor, rid)) {
+        if(p!=text && *(p-1)=='"') {
+            *p++ = ',';
+        }
+        *p++ = '"';
+        uuid_unparse_lower(rid, p);
+        p += UUIDBUFLEN - 1;
+        *p++ = '"';
+    }
+    if(set->count!=1) {
+        *p++ = ']';
+    }
+    *p = 0;
+
+    return text;
+}
\ No newline at end of file
@@ -0,0 +1,44 @@
+#ifndef _RIDSET_H_
+#define _RIDSET_H_
+
+#include <stdbool.h>
+#include <uuid/uuid.h>
+#include <glib.h>
+
+//open addressing set of binary request ids, the nil uuid marks an empty slot
+typedef struct RidSet {
+    guint count;
+    guint capacity;//power of 2
+    uuid_t *slots;
+} RidSet;
+
+extern bool rid_parse(const char *text, uuid_t rid);//false for malformed, uppercase or nil uuid
+extern RidSet *rid_set_new(void);
+extern RidSet *rid_set_copy(const RidSet *set);
+extern void rid_set_free(RidSet *set);
+extern bool rid_set_add(RidSet *set, const uuid_t rid);//return true when rid is new
+extern bool rid_set_remove(RidSet *set, const uuid_t rid);
+extern bool rid_set_contains(const RidSet *set, const uuid_t rid);
+extern bool rid_set_next(const RidSet *set, guint *cursor, uuid_t rid);//cursor starts at 0
+
+//refcounted subscriber set, never modified while another holder has a reference
+typedef struct RidSnapshot {
+    gint ref;
+    RidSet *set;
+    char *text;//serialized rid, a json string for one request or a json array, built on first use
+} RidSnapshot;
+
+extern RidSnapshot *rid_snapshot_new(RidSet *set);//take over set
+extern RidSnapshot *rid_snapshot_ref(RidSnapshot *snapshot);
+extern void rid_snapshot_unref(RidSnapshot *snapshot);
+extern bool rid_snapshot_shared(const RidSnapshot *snapshot);
+extern RidSet *rid_snapshot_edit(RidSnapshot *snapshot);//only for an unshared snapshot, drop the cached text
+extern const char *rid_snapshot_text(RidSnapshot *snapshot);
+
+//GHashTable helpers for uuid_t keys allocated with rid_dup
+extern unsigned char *rid_dup(const uuid_t rid);
+extern guint64 rid_mix(const unsigned char *rid);//bits 56 and above are left for sharding
+extern guint rid_hash(const unsigned char *rid);
+extern gboolean rid_equal(const unsigned char *rid1, const unsigned char *rid2);
+
+#endif //_RIDSET_H_
\ No newline at end of file
@@ -0,0 +1,123 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "taskkey.h"
+
+#define TASKKEY_FNV_OFFSET 14695981039346656037ULL
+#define TASKKEY_FNV_PRIME 1099511628211ULL
+
+//property
+static pthread_mutex_t task_key_lock;
+static GHashTable *task_key_table = NULL;//text hash to TaskKey, keys are not owned
+
+//function
+static guint64 task_key_text_hash(const char *text, size_t length);
+
+void task_key_table_create(void) {
+    pthread_mutexattr_t mtx_attr;
+
+    if(task_key_table==NULL) {
+        pthread_mutexattr_init(&mtx_attr);
+        pthread_mutexattr_setpshared(&mtx_attr, PTHREAD_PROCESS_PRIVATE);
+        pthread_mutexattr_settype(&mtx_attr, PTHREAD_MUTEX_NORMAL);
+        pthread_mutex_init(&task_key_lock, &mtx_attr);
+        pthread_mutexattr_destroy(&mtx_attr);
+
+        task_key_table = g_hash_table_new((GHashFunc)task_key_hash, (GEqualFunc)task_key_equal);
+    }
+}
+
+//keys still referenced are leaked on purpose, their owners are gone at this point
+void task_key_table_destroy(void) {
+    if(task_key_table!=NULL) {
+        g_hash_table_destroy(task_key_table);
+        task_key_table = NULL;
+        pthread_mutex_destroy(&task_key_lock);
+    }
+}
+
+//the text is hashed once here, later respond table operations only use hash and length,
+//a stack probe looks the text up so that only a new key is allocated and copied
+TaskKey *task_key_intern(const char *text) {
+    TaskKey probe, *key;
+    char *storage;
+
+    probe.length = strlen(text);
+    probe.hash = task_key_text_hash(text, probe.length);
+    probe.text = text;
+
+    pthread_mutex_lock(&task_key_lock);
+    key = (TaskKey*)g_hash_table_lookup(task_key_table, &probe);
+    if(key!=NULL) {
+        atomic_fetch_add(&key->ref, 1);
+    } else {
+        key = (TaskKey*)malloc(sizeof(TaskKey) + probe.length + 1);
+        storage = (char*)(key + 1);
+        memcpy(storage, text, probe.length + 1);
+        atomic_init(&key->ref, 1);
+        key->hash = probe.hash;
+        key->length = probe.length;
+        key->text = storage;
+        g_hash_table_add(task_key_table, key);
+    }
+    pthread_mutex_unlock(&task_key_lock);
+
+    return key;
+}
+
+//the caller holds a reference, the key can not be dying
+TaskKey *task_key_ref(TaskKey *key) {
+    atomic_fetch_add(&key->ref, 1);
+    return key;
+}
+
+//a count above one drops without the lock, the last reference is dropped under it
+//so that intern, which only counts up under the lock, never revives a key being freed
+void task_key_unref(TaskKey *key) {
+    guint ref;
+    bool last;
+
+    if(key==NULL) {
+        return;
+    }
+
+    ref = atomic_load(&key->ref);
+    while(ref>1) {
+        if(atomic_compare_exchange_weak(&key->ref, &ref, ref - 1)) {
+            return;
+        }
+    }
+
+    pthread_mutex_lock(&task_key_lock);
+    last = atomic_fetch_sub(&key->ref, 1)==1;
+    if(last) {
+        g_hash_table_remove(task_key_table, key);
+    }
+    pthread_mutex_unlock(&task_key_lock);
+
+    if(last) {
+        free(key);
+    }
+}
+
+guint task_key_hash(const TaskKey *key) {
+    return (guint)(key->hash ^ (key->hash >> 32));
+}
+
+gboolean task_key_equal(const TaskKey *k1, const TaskKey *k2) {
+    return k1==k2 || (k1->hash==k2->hash && k1->length==k2->length && memcmp(k1->text, k2->text, k1->length)==0);
+}
+
+//64-bit FNV-1a
+static guint64 task_key_text_hash(const char *text, size_t length) {
+    guint64 hash = TASKKEY_FNV_OFFSET;
+    size_t i;
+
+    for(i=0; i<length; i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= TASKKEY_FNV_PRIME;
+    }
+    return hash;
+}
\ No newline at end of file
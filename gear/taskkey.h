@@ -0,0 +1,24 @@
+#ifndef _TASKKEY_H_
+#define _TASKKEY_H_
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <glib.h>
+
+//interned respond table key, one object per distinct unformatted {"service":..., "payload":...} text
+typedef struct TaskKey {
+    _Atomic guint ref;
+    guint64 hash;
+    size_t length;
+    const char *text;//points at the storage that follows the key, or at the caller text of a lookup probe
+} TaskKey;
+
+extern void task_key_table_create(void);
+extern void task_key_table_destroy(void);
+extern TaskKey *task_key_intern(const char *text);//return a new reference
+extern TaskKey *task_key_ref(TaskKey *key);
+extern void task_key_unref(TaskKey *key);
+extern guint task_key_hash(const TaskKey *key);
+extern gboolean task_key_equal(const TaskKey *k1, const TaskKey *k2);
+
+#endif //_TASKKEY_H_
\ No newline at end of file
@@ -0,0 +1,229 @@
+#include <sys/syscall.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#include "define.h"
+#include "log.h"
+#include "globaldata.h"
+#include "trace.h"
+
+#define TRACE_RING_SPANS 16384//power of 2, the oldest spans are overwritten
+#define TRACE_DEFAULT_SUFFIX "-trace.json"
+
+typedef struct TraceSpan {
+    uuid_t rid;
+    enum TraceStage stage;
+    uint32_t tid;
+    uint64_t start;
+    uint64_t end;
+} TraceSpan;
+
+//sequence is odd while the span is written, 2 * (index + 1) once it is complete
+typedef struct TraceSlot {
+    _Atomic uint64_t sequence;
+    TraceSpan span;
+} TraceSlot;
+
+static const char *trace_stage_names[TRACE_STAGE_COUNT] = {
+    "channel_read", "payload_parse", "parse_queue", "proxy_run", "reply_queue", "subscribe_handshake"
+};
+
+//property
+static volatile unsigned int trace_sample = 0;
+static TraceSlot *trace_ring = NULL;
+static _Atomic uint64_t trace_next = 0;
+static char *trace_path = NULL;
+static bool trace_chrome = false;
+static pid_t trace_pid = 0;
+static volatile sig_atomic_t trace_dump_requested = 0;
+static __thread unsigned int trace_countdown = 0;
+static __thread uint32_t trace_tid = 0;
+
+//function
+static uint64_t trace_now(void);
+static void trace_emit(const TraceContext *trace, enum TraceStage stage, uint64_t end);
+static bool trace_read(uint64_t index, TraceSpan *span);
+
+void trace_context_init(const ConfVar *cv_head, pid_t pid) {
+    const char *value, *log_path;
+    unsigned int sample;
+
+    if(!confvar_uint(cv_head, CONF_TRACE_SAMPLE, &sample) || sample<1) {
+        return;
+    }
+    trace_ring = (TraceSlot*)calloc(TRACE_RING_SPANS, sizeof(TraceSlot));
+    if(trace_ring==NULL) {
+        proxy_log("ERROR", "trace buffer of %d spans cannot be allocated", TRACE_RING_SPANS);
+        return;
+    }
+    if( (value = confvar_value(cv_head, CONF_TRACE_PATH))!=NULL && strlen(value)>0 ) {
+        trace_path = strdup(value);
+    } else {
+        log_path = confvar_value(cv_head, CONF_LOGPATH);
+        trace_path = (char*)malloc(strlen(log_path) + strlen(proxy_name) + strlen(TRACE_DEFAULT_SUFFIX) + 2);
+        sprintf(trace_path, "%s/%s%s", log_path, proxy_name, TRACE_DEFAULT_SUFFIX);
+    }
+    value = confvar_value(cv_head, CONF_TRACE_FORMAT);
+    trace_chrome = value!=NULL && strcmp(value, "chrome")==0;
+    trace_pid = pid;
+    trace_sample = sample;
+    proxy_log("INFO", "trace one request in %u to %s", sample, trace_path);
+}
+
+void trace_context_destroy(void) {
+    trace_sample = 0;
+    if(trace_ring!=NULL) {
+        free(trace_ring);
+        trace_ring = NULL;
+    }
+    if(trace_path!=NULL) {
+        free(trace_path);
+        trace_path = NULL;
+    }
+}
+
+bool trace_enabled(void) {
+    return trace_sample>0;
+}
+
+void trace_begin(TraceContext *trace, const char *rid) {
+    unsigned int sample;
+
+    trace->sampled = false;
+    if( (sample = trace_sample)<1 ) {
+        return;
+    }
+    if(trace_countdown>0) {
+        trace_countdown--;
+        return;
+    }
+    trace_countdown = sample - 1;
+    if(rid==NULL || uuid_parse(rid, trace->rid)!=0) {
+        return;
+    }
+    trace->sampled = true;
+    trace->mark = trace_now();
+}
+
+void trace_untraced(TraceContext *trace) {
+    trace->sampled = false;
+}
+
+void trace_mark(TraceContext *trace) {
+    if(trace->sampled) {
+        trace->mark = trace_now();
+    }
+}
+
+void trace_span(TraceContext *trace, enum TraceStage stage) {
+    uint64_t now;
+
+    if(trace->sampled) {
+        now = trace_now();
+        trace_emit(trace, stage, now);
+        trace->mark = now;
+    }
+}
+
+void trace_dump_request(void) {
+    trace_dump_requested = 1;
+}
+
+bool trace_dump_pending(void) {
+    return trace_dump_requested!=0;
+}
+
+//spans still being written are skipped
+void trace_dump(void) {
+    char buff[PROXYLOGBUFLEN], rid[UUIDBUFLEN];
+    TraceSpan span;
+    uint64_t next, index, first;
+    unsigned int written;
+    FILE *f;
+
+    trace_dump_requested = 0;
+    if(trace_ring==NULL) {
+        return;
+    }
+    if( (f = fopen(trace_path, "w"))==NULL ) {
+        strerror_r(errno, buff, PROXYLOGBUFLEN);
+        proxy_log("ERROR", "trace dump to %s is failed %s", trace_path, buff);
+        return;
+    }
+
+    next = atomic_load(&trace_next);
+    first = next>TRACE_RING_SPANS ? next - TRACE_RING_SPANS : 0;
+    written = 0;
+    if(trace_chrome) {
+        fprintf(f, "{\"traceEvents\":[");
+    }
+    for(index=first; index<next; index++) {
+        if(!trace_read(index, &span)) {
+            continue;
+        }
+        uuid_unparse_lower(span.rid, rid);
+        if(trace_chrome) {
+            fprintf(f, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u,\"args\":{\"rid\":\"%s\"}}", 
+                written>0 ? "," : "", trace_stage_names[span.stage], span.start / 1000.0, (span.end - span.start) / 1000.0, 
+                (int)trace_pid, span.tid, rid);
+        } else {
+            fprintf(f, "{\"rid\":\"%s\",\"stage\":\"%s\",\"start_ns\":%llu,\"duration_ns\":%llu,\"tid\":%u}\n", 
+                rid, trace_stage_names[span.stage], (unsigned long long)span.start, (unsigned long long)(span.end - span.start), span.tid);
+        }
+        written++;
+    }
+    if(trace_chrome) {
+        fprintf(f, "\n]}\n");
+    }
+    fclose(f);
+    proxy_log("INFO", "trace dump of %u spans to %s", written, trace_path);
+}
+
+static uint64_t trace_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void trace_emit(const TraceContext *trace, enum TraceStage stage, uint64_t end) {
+    TraceSlot *slot;
+    uint64_t index;
+
+    if(trace_ring==NULL) {
+        return;
+    }
+    if(trace_tid==0) {
+        trace_tid = (uint32_t)syscall(SYS_gettid);//once per thread
+    }
+    index = atomic_fetch_add_explicit(&trace_next, 1, memory_order_relaxed);
+    slot = &trace_ring[index & (TRACE_RING_SPANS - 1)];
+    atomic_store_explicit(&slot->sequence, 2 * index + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    uuid_copy(slot->span.rid, trace->rid);
+    slot->span.stage = stage;
+    slot->span.tid = trace_tid;
+    slot->span.start = trace->mark;
+    slot->span.end = end;
+    atomic_store_explicit(&slot->sequence, 2 * (index + 1), memory_order_release);
+}
+
+static bool trace_read(uint64_t index, TraceSpan *span) {
+    TraceSlot *slot;
+    uint64_t sequence;
+
+    slot = &trace_ring[index & (TRACE_RING_SPANS - 1)];
+    sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    if(sequence!=2 * (index + 1)) {
+        return false;
+    }
+    memcpy(span, &slot->span, sizeof(TraceSpan));
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&slot->sequence, memory_order_relaxed)==sequence;
+}
\ No newline at end of file
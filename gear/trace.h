@@ -0,0 +1,39 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <uuid/uuid.h>
+
+#include "confvar.h"
+
+//sampled per request stage timing, spans of a request share its rid
+enum TraceStage {
+    TRACE_CHANNEL_READ = 0,//request received to acknowledgement
+    TRACE_PAYLOAD_PARSE,//ProxyPayloadParse
+    TRACE_PARSE_QUEUE,//waiting for proxycomm
+    TRACE_PROXY_RUN,//ProxyRun
+    TRACE_REPLY_QUEUE,//waiting for proxysubscribe
+    TRACE_SUBSCRIBE_HANDSHAKE,//answer to gonggo acknowledgement
+    TRACE_STAGE_COUNT
+};
+
+//travels with a request, every call is a single branch when the request is not sampled
+typedef struct TraceContext {
+    bool sampled;
+    uuid_t rid;
+    uint64_t mark;//start of the stage in progress, monotonic ns
+} TraceContext;
+
+extern void trace_context_init(const ConfVar *cv_head, pid_t pid);
+extern void trace_context_destroy(void);
+extern bool trace_enabled(void);
+extern void trace_begin(TraceContext *trace, const char *rid);//sampling decision and mark
+extern void trace_untraced(TraceContext *trace);
+extern void trace_mark(TraceContext *trace);
+extern void trace_span(TraceContext *trace, enum TraceStage stage);//span from the mark to now, then mark again
+extern void trace_dump_request(void);//async signal safe
+extern bool trace_dump_pending(void);
+extern void trace_dump(void);
+
+#endif //_TRACE_H_
\ No newline at end of file
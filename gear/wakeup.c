@@ -0,0 +1,148 @@
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <limits.h>
+#include <string.h>
+#include <errno.h>
+
+#include "wakeup.h"
+
+//function
+static int wakeup_sequence_wait(Wakeup *wakeup, const struct timespec *abstime);
+static void wakeup_sequence_signal(Wakeup *wakeup, int count);
+static long wakeup_futex(_Atomic uint32_t *addr, int op, uint32_t val, const struct timespec *abstime);
+static inline void wakeup_relax(void);
+
+bool wakeup_backend_parse(const char *name, enum ProxyWakeupBackend *backend) {
+    if(name==NULL || strcmp(name, "condvar")==0) {
+        *backend = WAKEUP_CONDVAR;
+    } else if(strcmp(name, "futex")==0) {
+        *backend = WAKEUP_FUTEX;
+    } else if(strcmp(name, "spin")==0) {
+        *backend = WAKEUP_SPIN;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char *wakeup_backend_name(enum ProxyWakeupBackend backend) {
+    switch(backend) {
+        case WAKEUP_FUTEX:
+            return "futex";
+        case WAKEUP_SPIN:
+            return "spin";
+        default:
+            return "condvar";
+    }
+}
+
+//spinning on a single cpu only delays the signaler, the spin backend sleeps at once there
+void wakeup_bind(Wakeup *wakeup, enum ProxyWakeupBackend backend, unsigned int spin, pthread_mutex_t *lock, pthread_cond_t *cond, ProxyWakeupWord *word) {
+    wakeup->backend = backend;
+    wakeup->spin = sysconf(_SC_NPROCESSORS_ONLN)>1 ? spin : 0;
+    wakeup->lock = lock;
+    wakeup->cond = cond;
+    wakeup->word = word;
+}
+
+//both cond and word are initialized, whichever backend the other side runs finds them ready
+void wakeup_init(Wakeup *wakeup) {
+    pthread_condattr_t condattr;
+
+    pthread_condattr_init(&condattr);
+    pthread_condattr_setpshared(&condattr, PTHREAD_PROCESS_SHARED);
+    pthread_cond_init(wakeup->cond, &condattr);
+    pthread_condattr_destroy(&condattr);//condattr is no longer needed
+
+    atomic_store(&wakeup->word->sequence, 0);
+    atomic_store(&wakeup->word->parked, 0);
+}
+
+void wakeup_signal(Wakeup *wakeup) {
+    if(wakeup->backend==WAKEUP_CONDVAR) {
+        pthread_cond_signal(wakeup->cond);
+    } else {
+        wakeup_sequence_signal(wakeup, 1);
+    }
+}
+
+void wakeup_broadcast(Wakeup *wakeup) {
+    if(wakeup->backend==WAKEUP_CONDVAR) {
+        pthread_cond_broadcast(wakeup->cond);
+    } else {
+        wakeup_sequence_signal(wakeup, INT_MAX);
+    }
+}
+
+int wakeup_wait(Wakeup *wakeup) {
+    if(wakeup->backend==WAKEUP_CONDVAR) {
+        return pthread_cond_wait(wakeup->cond, wakeup->lock);
+    }
+    return wakeup_sequence_wait(wakeup, NULL);
+}
+
+int wakeup_timedwait(Wakeup *wakeup, const struct timespec *abstime) {
+    if(wakeup->backend==WAKEUP_CONDVAR) {
+        return pthread_cond_timedwait(wakeup->cond, wakeup->lock, abstime);
+    }
+    return wakeup_sequence_wait(wakeup, abstime);
+}
+
+//sequence is read under lock and every signal bumps it under lock, a signal after the unlock is never missed
+//parked is published before sequence is checked again, a signaler either sees it or has already moved sequence
+//backend and spin are read under lock too, they may be rebound while this waiter sleeps
+static int wakeup_sequence_wait(Wakeup *wakeup, const struct timespec *abstime) {
+    uint32_t sequence;
+    unsigned int i, spin;
+    int status;
+
+    sequence = atomic_load(&wakeup->word->sequence);
+    spin = wakeup->backend==WAKEUP_SPIN ? wakeup->spin : 0;
+    pthread_mutex_unlock(wakeup->lock);
+
+    if(spin>0) {
+        for(i=0; i<spin && atomic_load_explicit(&wakeup->word->sequence, memory_order_acquire)==sequence; i++) {
+            wakeup_relax();
+        }
+    }
+
+    status = 0;
+    if(atomic_load(&wakeup->word->sequence)==sequence) {
+        atomic_fetch_add(&wakeup->word->parked, 1);
+        while(status==0 && atomic_load(&wakeup->word->sequence)==sequence) {
+            if(wakeup_futex(&wakeup->word->sequence, FUTEX_WAIT_BITSET | FUTEX_CLOCK_REALTIME, sequence, abstime)==-1 && errno==ETIMEDOUT) {
+                status = ETIMEDOUT;
+            }//EAGAIN and EINTR fall back to the check
+        }
+        atomic_fetch_sub(&wakeup->word->parked, 1);
+    }
+
+    if(pthread_mutex_lock(wakeup->lock)==EOWNERDEAD) {
+        return EOWNERDEAD;//caller makes it consistent like after pthread_cond_wait
+    }
+    return status;
+}
+
+static void wakeup_sequence_signal(Wakeup *wakeup, int count) {
+    atomic_fetch_add(&wakeup->word->sequence, 1);
+    if(atomic_load(&wakeup->word->parked)>0) {
+        wakeup_futex(&wakeup->word->sequence, FUTEX_WAKE, (uint32_t)count, NULL);
+    }
+}
+
+//segments are shared between processes, the private futex ops do not apply
+static long wakeup_futex(_Atomic uint32_t *addr, int op, uint32_t val, const struct timespec *abstime) {
+    if(op==FUTEX_WAKE) {
+        return syscall(SYS_futex, (uint32_t*)addr, op, val, NULL, NULL, 0);
+    }
+    return syscall(SYS_futex, (uint32_t*)addr, op, val, abstime, NULL, FUTEX_BITSET_MATCH_ANY);
+}
+
+static inline void wakeup_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
\ No newline at end of file
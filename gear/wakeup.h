@@ -0,0 +1,31 @@
+#ifndef _WAKEUP_H_
+#define _WAKEUP_H_
+
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "proxy.h"
+
+#define WAKEUP_SPIN_DEFAULT 1000
+
+//one direction of a segment handshake, waiters and signalers hold lock like with pthread_cond_t,
+//WAKEUP_CONDVAR uses cond, the other backends use word so that a waiter killed in its sleep leaves nothing behind
+typedef struct Wakeup {
+    enum ProxyWakeupBackend backend;
+    unsigned int spin;
+    pthread_mutex_t *lock;
+    pthread_cond_t *cond;
+    ProxyWakeupWord *word;
+} Wakeup;
+
+extern bool wakeup_backend_parse(const char *name, enum ProxyWakeupBackend *backend);//NULL name is WAKEUP_CONDVAR
+extern const char *wakeup_backend_name(enum ProxyWakeupBackend backend);
+extern void wakeup_bind(Wakeup *wakeup, enum ProxyWakeupBackend backend, unsigned int spin, pthread_mutex_t *lock, pthread_cond_t *cond, ProxyWakeupWord *word);
+extern void wakeup_init(Wakeup *wakeup);//segment creator, before the other side maps it
+extern void wakeup_signal(Wakeup *wakeup);//lock held
+extern void wakeup_broadcast(Wakeup *wakeup);//lock held
+extern int wakeup_wait(Wakeup *wakeup);//lock held, 0 or EOWNERDEAD like pthread_cond_wait
+extern int wakeup_timedwait(Wakeup *wakeup, const struct timespec *abstime);//CLOCK_REALTIME abstime, ETIMEDOUT as well
+
+#endif //_WAKEUP_H_
\ No newline at end of file
@@ -2,6 +2,8 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <errno.h>
 
@@ -9,9 +11,15 @@
 #include "error.h"
 #include "confvar.h"
 #include "log.h"
+#include "objectpool.h"
+#include "jsonarena.h"
+#include "metrics.h"
+#include "trace.h"
+#include "taskkey.h"
 #include "respondtable.h"
 #include "replyqueue.h"
 #include "parsequeue.h"
+#include "parseworker.h"
 #include "proxychannel.h"
 #include "proxysubscribe.h"
 #include "gonggoalive.h"
@@ -27,7 +35,7 @@ const char *proxy_name = NULL;
 
 static void handler(int signal, siginfo_t *info, void *context);
 static void clean_up(void);
-static void threads_stop(pthread_t t_proxy_channel, pthread_t t_proxy_subscribe, pthread_t t_gonggo_alive, pthread_t t_proxy_comm);
+static void threads_stop(pthread_t *t_proxy_channel, pthread_t *t_parse_worker, pthread_t t_proxy_subscribe, pthread_t t_gonggo_alive, pthread_t t_proxy_comm);
 
 int work(pid_t pid, const ConfVar *cv_head, 
 	ProxyPayloadParse f_payload_parse, 
@@ -36,8 +44,9 @@ int work(pid_t pid, const ConfVar *cv_head,
 {
 	struct sigaction action;	
 	char buff[PROXYLOGBUFLEN];
-    pthread_t t_proxy_channel, t_proxy_subscribe, t_gonggo_alive, t_proxy_comm;    	
+    pthread_t *t_proxy_channel, *t_parse_worker, t_proxy_subscribe, t_gonggo_alive, t_proxy_comm;    	
     pthread_attr_t thread_attr;
+	unsigned int lane, worker;
 	
 	proxy_uuid_init();
 
@@ -46,16 +55,21 @@ int work(pid_t pid, const ConfVar *cv_head,
 	
 	proxy_log_context_init(pid, confvar_value(cv_head, CONF_LOGPATH));
 
+	//checked before the writer thread starts, these lines are written at once
 	if(f_payload_parse==NULL) {
 		proxy_log("ERROR", "f_payload_parse is NULL");
+		proxy_log_context_destroy();
 		return ERROR_START;
 	}
 
 	if(f_run==NULL) {
 		proxy_log("ERROR", "f_run is NULL");
+		proxy_log_context_destroy();
 		return ERROR_START;
 	}
 
+	proxy_log_configure(cv_head);
+
     memset(&action, 0, sizeof(action));
     action.sa_flags = SA_SIGINFO;
     action.sa_sigaction = handler;
@@ -67,6 +81,15 @@ int work(pid_t pid, const ConfVar *cv_head,
     }
 
 ////tables:BEGIN
+	json_arena_init(cv_head);
+	metrics_context_init(cv_head, pid);
+	trace_context_init(cv_head, pid);
+	if(trace_enabled() && sigaction(SIGUSR1, &action, NULL)==-1) {
+        strerror_r(errno, buff, PROXYLOGBUFLEN);
+        proxy_log("ERROR", "sigaction for trace dump failed %s", buff);
+	}
+	object_pool_create();
+	task_key_table_create();
 	respond_table_create();
 	reply_queue_create();
 	parse_queue_create();
@@ -79,12 +102,12 @@ int work(pid_t pid, const ConfVar *cv_head,
 	}	
 
 ////thread context initialization:BEGIN	    
-    if(!proxy_channel_context_init(f_payload_parse, f_rest)) {
+    if(!proxy_channel_context_init(cv_head, f_payload_parse, f_rest)) {
 		clean_up();
 		return ERROR_START;
 	}
 	
-    if(!proxy_subscribe_context_init()){
+    if(!proxy_subscribe_context_init(cv_head)){
 		proxy_channel_shm_unlink_enable();
         proxy_channel_context_destroy();
 		clean_up();
@@ -101,6 +124,7 @@ int work(pid_t pid, const ConfVar *cv_head,
 	}
 
 	proxy_comm_context_init(f_start, f_run, f_multirespond_clear, f_stop);
+	parse_worker_context_init(cv_head);
 ////thread context initialization:END
 
 	ProxyCommData proxy_comm_data = {.cv_head = cv_head};
@@ -108,12 +132,30 @@ int work(pid_t pid, const ConfVar *cv_head,
     pthread_attr_init(&thread_attr);
     pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_JOINABLE);
 	bool started = false;
+	t_proxy_channel = (pthread_t*)calloc(proxy_channel_lane_count(), sizeof(pthread_t));
+	t_parse_worker = (pthread_t*)calloc(parse_worker_count() + 1, sizeof(pthread_t));
 	do {
-		if(pthread_create(&t_proxy_channel, &thread_attr, proxy_channel, (void*)cv_head)!=0) {
+		for(worker=0; worker<parse_worker_count(); worker++) {
+			if(pthread_create(&t_parse_worker[worker], &thread_attr, parse_worker, (void*)(uintptr_t)worker)!=0) {
+				break;
+			}
+			parse_worker_waitfor_started(worker);
+		}
+		if(worker<parse_worker_count()) {
+			proxy_log("ERROR", "cannot start server, %s", "parse worker thread creation is failed");
+			break;
+		}
+
+		for(lane=0; lane<proxy_channel_lane_count(); lane++) {
+			if(pthread_create(&t_proxy_channel[lane], &thread_attr, proxy_channel, (void*)(uintptr_t)lane)!=0) {
+				break;
+			}
+			proxy_channel_waitfor_started(lane);
+		}
+		if(lane<proxy_channel_lane_count()) {
 			proxy_log("ERROR", "cannot start server, %s", "proxy channel thread creation is failed");
 			break;
 		}
-		proxy_channel_waitfor_started();
 
 		if(pthread_create(&t_proxy_subscribe, &thread_attr, proxy_subscribe, NULL)!=0) {
 			proxy_log("ERROR", "cannot start server, %s", "proxy subscribe thread creation is failed");
@@ -141,7 +183,9 @@ int work(pid_t pid, const ConfVar *cv_head,
     if(!started)  {
 		alive_mutex_die();	
 		proxy_exit = true;
-		threads_stop(t_proxy_channel, t_proxy_subscribe, t_gonggo_alive, t_proxy_comm);
+		threads_stop(t_proxy_channel, t_parse_worker, t_proxy_subscribe, t_gonggo_alive, t_proxy_comm);
+		free(t_proxy_channel);
+		free(t_parse_worker);
 		clean_up();
         return ERROR_START;
 	}
@@ -150,12 +194,18 @@ int work(pid_t pid, const ConfVar *cv_head,
 
 	while(!proxy_exit) {
         pause();
+		if(trace_dump_pending()) {
+			trace_dump();
+		}
 	}
 
     proxy_log("INFO", "proxy %s is stopping", proxy_name);
 
 	alive_mutex_die();
-    threads_stop(t_proxy_channel, t_proxy_subscribe, t_gonggo_alive, t_proxy_comm);
+    threads_stop(t_proxy_channel, t_parse_worker, t_proxy_subscribe, t_gonggo_alive, t_proxy_comm);
+	free(t_proxy_channel);
+	free(t_parse_worker);
+	trace_dump();
     proxy_log("INFO", "proxy %s is stopped", proxy_name);
     clean_up();
 
@@ -165,6 +215,8 @@ int work(pid_t pid, const ConfVar *cv_head,
 static void handler(int signal, siginfo_t *info, void *context) {
     if(signal==SIGTERM) {
         proxy_exit = true;
+	} else if(signal==SIGUSR1) {
+		trace_dump_request();
 	}
 }
 
@@ -174,16 +226,28 @@ static void clean_up(void) {
 	respond_table_destroy();
 	reply_queue_destroy();
 	parse_queue_destroy();
+	task_key_table_destroy();
+	object_pool_destroy();
+	json_arena_destroy();
+	metrics_context_destroy();
+	trace_context_destroy();
  	alive_mutex_destroy();
 }
 
-static void threads_stop(pthread_t t_proxy_channel, pthread_t t_proxy_subscribe, pthread_t t_gonggo_alive, pthread_t t_proxy_comm) 
+static void threads_stop(pthread_t *t_proxy_channel, pthread_t *t_parse_worker, pthread_t t_proxy_subscribe, pthread_t t_gonggo_alive, pthread_t t_proxy_comm) 
 {	
-	if(proxy_channel_isstarted()) { 
+	unsigned int lane, worker;
+
+	if(proxy_channel_isstarted(0)) { 
 		proxy_log("INFO", "proxy_channel thread stopping");
 		proxy_channel_stop(); 
 		proxy_log("INFO", "proxy_channel thread stopping done");
 	}
+	if(parse_worker_isstarted(0)) { 
+		proxy_log("INFO", "parse_worker thread stopping");
+		parse_worker_stop(); 
+		proxy_log("INFO", "parse_worker thread stopping done");
+	}
 	if(proxy_subscribe_isstarted()) { 
 		proxy_log("INFO", "proxy_subscribe thread stopping");
 		proxy_subscribe_stop(); 
@@ -200,10 +264,19 @@ static void threads_stop(pthread_t t_proxy_channel, pthread_t t_proxy_subscribe,
 		proxy_log("INFO", "proxy_comm thread stopping done");
 	}
 
-	if(proxy_channel_isstarted()) { 
-		proxy_log("INFO", "proxy_channel thread joining");
-		pthread_join(t_proxy_channel, NULL); 
-		proxy_log("INFO", "proxy_channel thread joining done");
+	for(lane=0; lane<proxy_channel_lane_count(); lane++) {
+		if(proxy_channel_isstarted(lane)) { 
+			proxy_log("INFO", "proxy_channel %u thread joining", lane);
+			pthread_join(t_proxy_channel[lane], NULL); 
+			proxy_log("INFO", "proxy_channel %u thread joining done", lane);
+		}
+	}
+	for(worker=0; worker<parse_worker_count(); worker++) {
+		if(parse_worker_isstarted(worker)) { 
+			proxy_log("INFO", "parse_worker %u thread joining", worker);
+			pthread_join(t_parse_worker[worker], NULL); 
+			proxy_log("INFO", "parse_worker %u thread joining done", worker);
+		}
 	}
 	if(proxy_subscribe_isstarted()) { 
 		proxy_log("INFO", "proxy_subscribe thread joining");
@@ -222,6 +295,7 @@ static void threads_stop(pthread_t t_proxy_channel, pthread_t t_proxy_subscribe,
 	}
 
 	proxy_channel_context_destroy();
+	parse_worker_context_destroy();
     proxy_subscribe_context_destroy();
 	gonggo_alive_context_destroy();
 	proxy_comm_context_destroy();
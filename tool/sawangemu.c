@@ -0,0 +1,1085 @@
+//emulate the gonggo dispatcher half of the shared memory protocol, load test a sawang proxy without gonggo
+//usage: sawangemu -g <gonggo name> [-r requests per second] [-d seconds] [-b batch] [-w grace seconds] [-k wakeup] -m <mix> [-m <mix> ...]
+//mix is <kind>:<weight>[:<service>[:<payload json>]], kind is singleshot, multirespond, unsubscribe, drop or rest,
+//$seq in a payload is replaced by the request sequence number so that requests do not share one task,
+//wakeup is the condvar, futex or spin backend of /<gonggo>, the proxy segments tell their own
+//start sawangemu first, then the proxy configured with gonggo=<gonggo name>, the proxy exits when sawangemu is done
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <uuid/uuid.h>
+#include <glib.h>
+
+#include "cJSON.h"
+#include "define.h"
+#include "proxy.h"
+#include "gonggoalive.h"
+#include "wakeup.h"
+#include "payloadring.h"
+
+#define EMU_LANES_MAX 128
+#define EMU_WAIT_NS 100000000L//every wait wakes up to look at the stop flags
+#define EMU_SEQ_TOKEN "$seq"
+
+enum EmuKind {
+    EMU_SINGLESHOT = 0,
+    EMU_MULTIRESPOND,
+    EMU_UNSUBSCRIBE,
+    EMU_DROP,
+    EMU_REST,
+    EMU_KIND_COUNT
+};
+
+static const char *emu_kind_names[EMU_KIND_COUNT] = { "singleshot", "multirespond", "unsubscribe", "drop", "rest" };
+
+typedef struct EmuMix {
+    enum EmuKind kind;
+    unsigned int weight;
+    char *service;
+    char *payload;//json text, NULL for an empty object
+} EmuMix;
+
+typedef struct EmuPending {
+    enum EmuKind kind;
+    uint64_t sent;
+    bool answered;
+} EmuPending;
+
+typedef struct EmuStats {
+    uint64_t sent;
+    uint64_t failed;//refused by the proxy or skipped for lack of a subscription
+    uint64_t answered;
+    uint64_t stream;//further answers of a multirespond request
+    uint64_t *samples;//end to end ns of the first answer
+    size_t sample_count;
+    size_t sample_capacity;
+} EmuStats;
+
+typedef struct EmuRequest {
+    char rid[UUIDBUFLEN];
+    char subscription[UUIDBUFLEN];//rid unsubscribed or dropped
+    char *text;
+    size_t length;//including terminator
+    ProxyRingSlot slot;//sequence 0 when the payload is in the /<rid> segment
+    enum EmuKind kind;
+    uint64_t due;
+    bool failed;
+} EmuRequest;
+
+typedef struct EmuLane {
+    char *path;
+    ProxyChannelShm *shm;
+    ProxyRingShm *ring;
+    Wakeup dispatcher_wakeup;
+    Wakeup proxy_wakeup;
+    Wakeup idle;
+    bool rest;
+    double rate;//requests per second, 0 is as fast as the handshake goes
+    unsigned int weight;//sum of the mix weights this lane serves
+    pthread_t thread;
+    bool started;
+} EmuLane;
+
+//property
+static const char *emu_gonggo = NULL;
+static char emu_proxy[PROXYNAMEBUFLEN];
+static double emu_rate = 1000;
+static unsigned int emu_duration = 10;
+static unsigned int emu_grace = 1;
+static unsigned int emu_batch = 1;
+static EmuMix emu_mix[EMU_KIND_COUNT * 4];
+static unsigned int emu_mix_count = 0;
+static volatile sig_atomic_t emu_interrupted = 0;
+static volatile bool emu_sending = true;
+static volatile bool emu_stop = false;
+static pthread_mutex_t emu_lock = PTHREAD_MUTEX_INITIALIZER;//guards everything below
+static GHashTable *emu_pending = NULL;//rid text to EmuPending
+static GPtrArray *emu_subscriptions = NULL;//acknowledged multirespond rids
+static EmuStats emu_stats[EMU_KIND_COUNT];
+static uint64_t emu_unmatched = 0;
+static unsigned long emu_sequence = 0;
+static GonggoAliveMutexShm *emu_alive = NULL;
+static ProxyActivationShm *emu_activation = NULL;
+static enum ProxyWakeupBackend emu_wakeup = WAKEUP_CONDVAR;
+static Wakeup emu_activation_dispatcher_wakeup;
+static Wakeup emu_activation_proxy_wakeup;
+static EmuLane emu_lanes[EMU_LANES_MAX];
+static unsigned int emu_lane_count = 0;
+static bool emu_rest_lanes = false;//REST requests go to REST lanes only
+static ProxySubscribeShm *emu_subscribe = NULL;
+static ProxyRingShm *emu_subscribe_ring = NULL;
+static Wakeup emu_subscribe_dispatcher_wakeup;
+static Wakeup emu_subscribe_proxy_wakeup;
+
+//function
+static bool emu_mix_parse(const char *text);
+static void emu_signal(int signal);
+static uint64_t emu_now(void);
+static struct timespec emu_deadline(long ns);
+static void *emu_shm_map(const char *path, size_t length, bool create);
+static ProxyRingShm *emu_ring_map(const char *path);
+static bool emu_lock_robust(pthread_mutex_t *lock);
+static void emu_shm_init(pthread_mutex_t *lock);
+static void emu_wakeup_bind(Wakeup *wakeup, enum ProxyWakeupBackend backend, unsigned int spin, pthread_mutex_t *lock, pthread_cond_t *cond, ProxyWakeupWord *word);
+static bool emu_gonggo_create(void);
+static void emu_gonggo_destroy(void);
+static bool emu_activate(void);
+static bool emu_proxy_open(void);
+static void emu_proxy_close(void);
+static void emu_lanes_plan(void);
+static const EmuMix *emu_choose(const EmuLane *lane, unsigned int *seed);
+static char *emu_payload_expand(const char *payload, unsigned long sequence);
+static bool emu_request_build(EmuRequest *request, const EmuMix *mix, uint64_t due);
+static void emu_request_clear(EmuRequest *request);
+static bool emu_rid_write(const EmuRequest *request);
+static bool emu_payload_write(EmuLane *lane, EmuRequest *request);
+static void *emu_lane_worker(void *arg);
+static bool emu_lane_waitfor_idle(EmuLane *lane);
+static void emu_channel_exchange(EmuLane *lane, EmuRequest *requests, unsigned int count);
+static void emu_rest_exchange(EmuLane *lane, EmuRequest *request);
+static void *emu_subscribe_worker(void *arg);
+static void emu_answer_parse(const char *text, size_t length, uint64_t now);
+static void emu_answer_rid(const char *rid, uint64_t now);
+static void emu_sample(EmuStats *stats, uint64_t ns);
+static int emu_compare(const void *a, const void *b);
+static double emu_percentile(const EmuStats *stats, double p);
+static void emu_report(double seconds);
+
+int main(int argc, char **argv) {
+    pthread_t subscribe_thread;
+    struct sigaction action;
+    uint64_t start, end;
+    unsigned int i;
+    int opt;
+
+    while( (opt = getopt(argc, argv, "g:r:d:b:w:k:m:"))!=-1 ) {
+        switch(opt) {
+            case 'g': emu_gonggo = optarg; break;
+            case 'r': emu_rate = atof(optarg); break;
+            case 'd': emu_duration = (unsigned int)atoi(optarg); break;
+            case 'b': emu_batch = (unsigned int)atoi(optarg); break;
+            case 'w': emu_grace = (unsigned int)atoi(optarg); break;
+            case 'k':
+                if(!wakeup_backend_parse(optarg, &emu_wakeup)) {
+                    fprintf(stderr, "wakeup %s is not condvar, futex or spin\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'm':
+                if(!emu_mix_parse(optarg)) {
+                    return 1;
+                }
+                break;
+            default:
+                emu_gonggo = NULL;
+                break;
+        }
+    }
+    if(emu_gonggo==NULL || strlen(emu_gonggo)<1) {
+        fprintf(stderr, "usage: %s -g <gonggo name> [-r requests per second] [-d seconds] [-b batch] [-w grace seconds] [-k wakeup] "
+            "-m <kind>:<weight>[:<service>[:<payload json>]] ...\n", argv[0]);
+        return 1;
+    }
+    if(emu_mix_count<1) {
+        fprintf(stderr, "at least one -m request mix is needed\n");
+        return 1;
+    }
+    if(emu_batch<1 || emu_batch>CHANNEL_BATCH_MAX) {
+        fprintf(stderr, "batch is between 1 and %d\n", CHANNEL_BATCH_MAX);
+        return 1;
+    }
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = emu_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    emu_pending = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+    emu_subscriptions = g_ptr_array_new_with_free_func(free);
+
+    if(!emu_gonggo_create()) {
+        emu_gonggo_destroy();
+        return 1;
+    }
+    printf("gonggo %s is up, waiting for a proxy activation\n", emu_gonggo);
+    fflush(stdout);
+    if(!emu_activate() || !emu_proxy_open()) {
+        emu_proxy_close();
+        emu_gonggo_destroy();
+        return 1;
+    }
+    emu_lanes_plan();
+
+    pthread_create(&subscribe_thread, NULL, emu_subscribe_worker, NULL);
+    start = emu_now();
+    for(i=0; i<emu_lane_count; i++) {
+        if(emu_lanes[i].weight>0) {
+            emu_lanes[i].started = pthread_create(&emu_lanes[i].thread, NULL, emu_lane_worker, &emu_lanes[i])==0;
+        }
+    }
+    for(i=0; i<emu_duration * 10 && !emu_interrupted && !emu_stop; i++) {
+        usleep(100000);
+    }
+    emu_sending = false;
+    for(i=0; i<emu_lane_count; i++) {
+        if(emu_lanes[i].started) {
+            pthread_join(emu_lanes[i].thread, NULL);
+        }
+    }
+    end = emu_now();
+    for(i=0; i<emu_grace * 10 && !emu_interrupted && !emu_stop; i++) {
+        usleep(100000);//answers still on their way
+    }
+    emu_stop = true;
+    pthread_join(subscribe_thread, NULL);
+
+    emu_report((end - start) / 1e9);
+
+    emu_proxy_close();
+    emu_gonggo_destroy();
+    g_hash_table_destroy(emu_pending);
+    g_ptr_array_free(emu_subscriptions, true);
+    for(i=0; i<EMU_KIND_COUNT; i++) {
+        free(emu_stats[i].samples);
+    }
+    for(i=0; i<emu_mix_count; i++) {
+        free(emu_mix[i].service);
+        free(emu_mix[i].payload);
+    }
+    return 0;
+}
+
+static bool emu_mix_parse(const char *text) {
+    char *copy, *kind, *weight, *service, *payload, *saveptr;
+    EmuMix *mix;
+    cJSON *json;
+    unsigned int i;
+
+    if(emu_mix_count>=sizeof(emu_mix) / sizeof(EmuMix)) {
+        fprintf(stderr, "too many -m request mixes\n");
+        return false;
+    }
+    mix = &emu_mix[emu_mix_count];
+    memset(mix, 0, sizeof(EmuMix));
+
+    copy = strdup(text);
+    kind = strtok_r(copy, ":", &saveptr);
+    weight = strtok_r(NULL, ":", &saveptr);
+    service = strtok_r(NULL, ":", &saveptr);
+    payload = strtok_r(NULL, "", &saveptr);//the rest, json has colons of its own
+    for(i=0; i<EMU_KIND_COUNT && (kind==NULL || strcmp(kind, emu_kind_names[i])!=0); i++);
+    if(i>=EMU_KIND_COUNT || weight==NULL || atoi(weight)<1) {
+        fprintf(stderr, "request mix %s is not <kind>:<weight>[:<service>[:<payload json>]]\n", text);
+        free(copy);
+        return false;
+    }
+    mix->kind = (enum EmuKind)i;
+    mix->weight = (unsigned int)atoi(weight);
+    if(mix->kind!=EMU_DROP && service==NULL) {
+        fprintf(stderr, "request mix %s needs a service\n", text);
+        free(copy);
+        return false;
+    }
+    mix->service = strdup(mix->kind==EMU_DROP ? GONGGOSERVICE_REQUEST_DROP : service);
+    if(payload!=NULL) {
+        json = cJSON_Parse(payload);//$seq has to sit inside a json string or stand for a number
+        if(json==NULL && strstr(payload, EMU_SEQ_TOKEN)==NULL) {
+            fprintf(stderr, "request mix %s payload is not json\n", text);
+            free(mix->service);
+            free(copy);
+            return false;
+        }
+        cJSON_Delete(json);
+        mix->payload = strdup(payload);
+    }
+    free(copy);
+    emu_mix_count++;
+    return true;
+}
+
+static void emu_signal(int signal) {
+    emu_interrupted = 1;
+}
+
+static uint64_t emu_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+//process shared conds of gonggo and sawang wait on CLOCK_REALTIME
+static struct timespec emu_deadline(long ns) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_nsec += ns;
+    ts.tv_sec += ts.tv_nsec / 1000000000L;
+    ts.tv_nsec %= 1000000000L;
+    return ts;
+}
+
+static void *emu_shm_map(const char *path, size_t length, bool create) {
+    void *map;
+    int fd;
+
+    fd = shm_open(path, create ? O_CREAT | O_RDWR : O_RDWR, S_IRUSR | S_IWUSR);
+    if(fd==-1) {
+        fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    if(create && ftruncate(fd, length)==-1) {
+        fprintf(stderr, "cannot size %s: %s\n", path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map==MAP_FAILED) {
+        fprintf(stderr, "cannot map %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    return map;
+}
+
+//the ring header tells the size of the data region that follows it
+static ProxyRingShm *emu_ring_map(const char *path) {
+    ProxyRingShm *header, *ring;
+    size_t capacity;
+
+    if( (header = (ProxyRingShm*)emu_shm_map(path, sizeof(ProxyRingShm), false))==NULL ) {
+        return NULL;
+    }
+    capacity = header->capacity;
+    munmap(header, sizeof(ProxyRingShm));
+    ring = (ProxyRingShm*)emu_shm_map(path, sizeof(ProxyRingShm) + capacity, false);
+    return ring;
+}
+
+//return false when the proxy died holding the lock, the lock is released then
+static bool emu_lock_robust(pthread_mutex_t *lock) {
+    if(pthread_mutex_lock(lock)==EOWNERDEAD) {
+        pthread_mutex_consistent(lock);
+        pthread_mutex_unlock(lock);
+        fprintf(stderr, "proxy %s died\n", emu_proxy);
+        emu_stop = true;
+        return false;
+    }
+    return true;
+}
+
+static void emu_shm_init(pthread_mutex_t *lock) {
+    pthread_mutexattr_t mutexattr;
+
+    pthread_mutexattr_init(&mutexattr);
+    pthread_mutexattr_setpshared(&mutexattr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&mutexattr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutexattr_settype(&mutexattr, PTHREAD_MUTEX_NORMAL);
+    pthread_mutex_init(lock, &mutexattr);
+    pthread_mutexattr_destroy(&mutexattr);
+}
+
+//the proxy wrote the backend of its segment, an unknown one can not be followed and is taken as condvar
+static void emu_wakeup_bind(Wakeup *wakeup, enum ProxyWakeupBackend backend, unsigned int spin, pthread_mutex_t *lock, pthread_cond_t *cond, ProxyWakeupWord *word) {
+    if(backend!=WAKEUP_FUTEX && backend!=WAKEUP_SPIN) {
+        backend = WAKEUP_CONDVAR;
+    }
+    wakeup_bind(wakeup, backend, spin, lock, cond, word);
+}
+
+//sawang looks for /<gonggo>_alive held by a living gonggo and /<gonggo> to activate itself
+static bool emu_gonggo_create(void) {
+    char path[SHMPATHBUFLEN + 8];
+
+    snprintf(path, sizeof(path), "/%s_alive", emu_gonggo);
+    if( (emu_alive = (GonggoAliveMutexShm*)emu_shm_map(path, sizeof(GonggoAliveMutexShm), true))==NULL ) {
+        return false;
+    }
+    emu_shm_init(&emu_alive->lock);
+    emu_alive->alive = true;
+    pthread_mutex_lock(&emu_alive->lock);//held until sawangemu is done
+
+    snprintf(path, sizeof(path), "/%s", emu_gonggo);
+    if( (emu_activation = (ProxyActivationShm*)emu_shm_map(path, sizeof(ProxyActivationShm), true))==NULL ) {
+        return false;
+    }
+    emu_shm_init(&emu_activation->lock);
+    wakeup_bind(&emu_activation_dispatcher_wakeup, emu_wakeup, WAKEUP_SPIN_DEFAULT, &emu_activation->lock, 
+        &emu_activation->dispatcher_wakeup, &emu_activation->dispatcher_word);
+    wakeup_bind(&emu_activation_proxy_wakeup, emu_wakeup, WAKEUP_SPIN_DEFAULT, &emu_activation->lock, 
+        &emu_activation->proxy_wakeup, &emu_activation->proxy_word);
+    wakeup_init(&emu_activation_dispatcher_wakeup);
+    wakeup_init(&emu_activation_proxy_wakeup);
+    emu_activation->wakeup = emu_wakeup;
+    emu_activation->wakeup_spin = WAKEUP_SPIN_DEFAULT;
+    emu_activation->proxy_name[0] = 0;
+    emu_activation->pid = 0;
+    emu_activation->state = ACTIVATION_IDLE;
+    return true;
+}
+
+//a graceful gonggo death, the proxy stops on its own
+static void emu_gonggo_destroy(void) {
+    char path[SHMPATHBUFLEN + 8];
+
+    if(emu_activation!=NULL) {
+        munmap(emu_activation, sizeof(ProxyActivationShm));
+        emu_activation = NULL;
+        snprintf(path, sizeof(path), "/%s", emu_gonggo);
+        shm_unlink(path);
+    }
+    if(emu_alive!=NULL) {
+        emu_alive->alive = false;
+        pthread_mutex_unlock(&emu_alive->lock);
+        usleep(100000);//let the proxy see it before the segment goes
+        munmap(emu_alive, sizeof(GonggoAliveMutexShm));
+        emu_alive = NULL;
+        snprintf(path, sizeof(path), "/%s_alive", emu_gonggo);
+        shm_unlink(path);
+    }
+}
+
+static bool emu_activate(void) {
+    struct timespec ts;
+    bool activated = false;
+
+    pthread_mutex_lock(&emu_activation->lock);
+    emu_activation->state = ACTIVATION_IDLE;
+    wakeup_broadcast(&emu_activation_proxy_wakeup);
+    while(!emu_interrupted && emu_activation->state!=ACTIVATION_REQUEST) {
+        ts = emu_deadline(EMU_WAIT_NS);
+        wakeup_timedwait(&emu_activation_dispatcher_wakeup, &ts);
+    }
+    if(emu_activation->state==ACTIVATION_REQUEST) {
+        snprintf(emu_proxy, PROXYNAMEBUFLEN, "%s", emu_activation->proxy_name);
+        emu_activation->state = ACTIVATION_SUCCESS;
+        wakeup_signal(&emu_activation_proxy_wakeup);
+        while(!emu_interrupted && emu_activation->state==ACTIVATION_SUCCESS) {
+            ts = emu_deadline(EMU_WAIT_NS);
+            wakeup_timedwait(&emu_activation_dispatcher_wakeup, &ts);
+        }
+        activated = emu_activation->state==ACTIVATION_DONE;
+        printf("proxy %s pid %d %s\n", emu_proxy, (int)emu_activation->pid, activated ? "is activated" : "fails to activate");
+        emu_activation->state = ACTIVATION_IDLE;//ready for the next proxy
+        wakeup_broadcast(&emu_activation_proxy_wakeup);
+    }
+    pthread_mutex_unlock(&emu_activation->lock);
+    return activated;
+}
+
+//the proxy created its channel lanes, REST lanes and subscribe segment before asking for activation
+static bool emu_proxy_open(void) {
+    char path[SHMPATHBUFLEN + 32], ring_path[SHMPATHBUFLEN + 40];
+    unsigned int i, lanes, rest_lanes;
+    EmuLane *lane;
+
+    snprintf(path, sizeof(path), "/%s_channel", emu_proxy);
+    lanes = 1;
+    rest_lanes = 0;
+    for(i=0; i<lanes + rest_lanes && i<EMU_LANES_MAX; i++) {
+        lane = &emu_lanes[emu_lane_count];
+        memset(lane, 0, sizeof(EmuLane));
+        if(i>=lanes) {
+            snprintf(path, sizeof(path), "/%s_rest_%u", emu_proxy, i - lanes);
+            lane->rest = true;
+        } else if(i>0) {
+            snprintf(path, sizeof(path), "/%s_channel_%u", emu_proxy, i);
+        }
+        if( (lane->shm = (ProxyChannelShm*)emu_shm_map(path, sizeof(ProxyChannelShm), false))==NULL ) {
+            return false;
+        }
+        lane->path = strdup(path);
+        emu_wakeup_bind(&lane->dispatcher_wakeup, lane->shm->wakeup, lane->shm->wakeup_spin, &lane->shm->lock, &lane->shm->dispatcher_wakeup, &lane->shm->dispatcher_word);
+        emu_wakeup_bind(&lane->proxy_wakeup, lane->shm->wakeup, lane->shm->wakeup_spin, &lane->shm->lock, &lane->shm->proxy_wakeup, &lane->shm->proxy_word);
+        emu_wakeup_bind(&lane->idle, lane->shm->wakeup, lane->shm->wakeup_spin, &lane->shm->lock, &lane->shm->idle, &lane->shm->idle_word);
+        emu_lane_count++;
+        if(i==0) {
+            lanes = lane->shm->lane_count>0 ? lane->shm->lane_count : 1;
+            rest_lanes = lane->shm->rest_lane_count;
+        }
+        if(lane->shm->ring_capacity>0) {
+            snprintf(ring_path, sizeof(ring_path), "%s_ring", path);
+            if( (lane->ring = emu_ring_map(ring_path))==NULL ) {
+                return false;
+            }
+        }
+    }
+
+    snprintf(path, sizeof(path), "/%s_subscribe", emu_proxy);
+    if( (emu_subscribe = (ProxySubscribeShm*)emu_shm_map(path, sizeof(ProxySubscribeShm), false))==NULL ) {
+        return false;
+    }
+    emu_wakeup_bind(&emu_subscribe_dispatcher_wakeup, emu_subscribe->wakeup, emu_subscribe->wakeup_spin, 
+        &emu_subscribe->lock, &emu_subscribe->dispatcher_wakeup, &emu_subscribe->dispatcher_word);
+    emu_wakeup_bind(&emu_subscribe_proxy_wakeup, emu_subscribe->wakeup, emu_subscribe->wakeup_spin, 
+        &emu_subscribe->lock, &emu_subscribe->proxy_wakeup, &emu_subscribe->proxy_word);
+    if(emu_subscribe->ring_capacity>0) {
+        snprintf(ring_path, sizeof(ring_path), "/%s_subscribe_ring", emu_proxy);
+        if( (emu_subscribe_ring = emu_ring_map(ring_path))==NULL ) {
+            return false;
+        }
+    }
+    printf("proxy %s has %u channel lanes and %u REST lanes, %s wakeup\n", emu_proxy, lanes, rest_lanes, wakeup_backend_name(emu_subscribe->wakeup));
+    return true;
+}
+
+static void emu_proxy_close(void) {
+    unsigned int i;
+
+    for(i=0; i<emu_lane_count; i++) {
+        if(emu_lanes[i].ring!=NULL) {
+            munmap(emu_lanes[i].ring, sizeof(ProxyRingShm) + emu_lanes[i].ring->capacity);
+        }
+        munmap(emu_lanes[i].shm, sizeof(ProxyChannelShm));
+        free(emu_lanes[i].path);
+    }
+    emu_lane_count = 0;
+    if(emu_subscribe_ring!=NULL) {
+        munmap(emu_subscribe_ring, sizeof(ProxyRingShm) + emu_subscribe_ring->capacity);
+        emu_subscribe_ring = NULL;
+    }
+    if(emu_subscribe!=NULL) {
+        munmap(emu_subscribe, sizeof(ProxySubscribeShm));
+        emu_subscribe = NULL;
+    }
+}
+
+//REST goes to the REST lanes when the proxy has some, every other kind is spread over the channel lanes
+static void emu_lanes_plan(void) {
+    unsigned int i, k, total, rest_weight, channels, rests;
+
+    total = rest_weight = 0;
+    for(k=0; k<emu_mix_count; k++) {
+        total += emu_mix[k].weight;
+        rest_weight += emu_mix[k].kind==EMU_REST ? emu_mix[k].weight : 0;
+    }
+    channels = rests = 0;
+    for(i=0; i<emu_lane_count; i++) {
+        emu_lanes[i].rest ? rests++ : channels++;
+    }
+    emu_rest_lanes = rests>0;
+    for(i=0; i<emu_lane_count; i++) {
+        if(emu_lanes[i].rest) {
+            emu_lanes[i].weight = rest_weight;
+            emu_lanes[i].rate = emu_rate * rest_weight / total / rests;
+        } else {
+            emu_lanes[i].weight = emu_rest_lanes ? total - rest_weight : total;
+            emu_lanes[i].rate = emu_rate * emu_lanes[i].weight / total / channels;
+        }
+    }
+}
+
+static const EmuMix *emu_choose(const EmuLane *lane, unsigned int *seed) {
+    unsigned int k, pick;
+
+    pick = (unsigned int)rand_r(seed) % lane->weight;
+    for(k=0; k<emu_mix_count; k++) {
+        if(lane->rest ? emu_mix[k].kind!=EMU_REST : (emu_rest_lanes && emu_mix[k].kind==EMU_REST)) {
+            continue;
+        }
+        if(pick<emu_mix[k].weight) {
+            return &emu_mix[k];
+        }
+        pick -= emu_mix[k].weight;
+    }
+    return NULL;
+}
+
+//replace every $seq with the sequence number
+static char *emu_payload_expand(const char *payload, unsigned long sequence) {
+    char number[24], *text, *p;
+    const char *token;
+    size_t count, length;
+
+    length = (size_t)snprintf(number, sizeof(number), "%lu", sequence);
+    count = 0;
+    for(token=strstr(payload, EMU_SEQ_TOKEN); token!=NULL; token=strstr(token + strlen(EMU_SEQ_TOKEN), EMU_SEQ_TOKEN)) {
+        count++;
+    }
+    text = (char*)malloc(strlen(payload) + count * length + 1);
+    p = text;
+    while( (token = strstr(payload, EMU_SEQ_TOKEN))!=NULL ) {
+        memcpy(p, payload, token - payload);
+        p += token - payload;
+        memcpy(p, number, length);
+        p += length;
+        payload = token + strlen(EMU_SEQ_TOKEN);
+    }
+    strcpy(p, payload);
+    return text;
+}
+
+//return false when an unsubscribe or drop finds no subscription to end
+static bool emu_request_build(EmuRequest *request, const EmuMix *mix, uint64_t due) {
+    cJSON *json, *payload, *rids;
+    char *payload_text;
+    unsigned long sequence;
+    guint index;
+    uuid_t rid;
+
+    memset(request, 0, sizeof(EmuRequest));
+    request->kind = mix->kind;
+    request->due = due;
+
+    pthread_mutex_lock(&emu_lock);
+    sequence = emu_sequence++;
+    if(mix->kind==EMU_UNSUBSCRIBE || mix->kind==EMU_DROP) {
+        if(emu_subscriptions->len<1) {
+            emu_stats[mix->kind].failed++;
+            pthread_mutex_unlock(&emu_lock);
+            return false;
+        }
+        index = sequence % emu_subscriptions->len;
+        snprintf(request->subscription, UUIDBUFLEN, "%s", (const char*)g_ptr_array_index(emu_subscriptions, index));
+        g_ptr_array_remove_index_fast(emu_subscriptions, index);
+    }
+    pthread_mutex_unlock(&emu_lock);
+
+    payload = NULL;
+    if(mix->payload!=NULL) {
+        payload_text = emu_payload_expand(mix->payload, sequence);
+        payload = cJSON_Parse(payload_text);
+        free(payload_text);
+    }
+    if(payload==NULL) {
+        payload = cJSON_CreateObject();
+    }
+    if(mix->kind==EMU_UNSUBSCRIBE) {
+        cJSON_DeleteItemFromObject(payload, SERVICE_RID_KEY);
+        cJSON_AddStringToObject(payload, SERVICE_RID_KEY, request->subscription);
+    } else if(mix->kind==EMU_DROP) {
+        cJSON_DeleteItemFromObject(payload, SERVICE_RID_KEY);
+        rids = cJSON_AddArrayToObject(payload, SERVICE_RID_KEY);
+        cJSON_AddItemToArray(rids, cJSON_CreateString(request->subscription));
+    }
+    json = cJSON_CreateObject();
+    cJSON_AddStringToObject(json, SERVICE_SERVICE_KEY, mix->service);
+    cJSON_AddItemToObject(json, SERVICE_PAYLOAD_KEY, payload);
+    request->text = cJSON_PrintUnformatted(json);
+    request->length = strlen(request->text) + 1;
+    cJSON_Delete(json);
+
+    memset(&request->slot, 0, sizeof(ProxyRingSlot));
+
+    uuid_generate(rid);
+    uuid_unparse_lower(rid, request->rid);
+    return true;
+}
+
+static void emu_request_clear(EmuRequest *request) {
+    char path[UUIDBUFLEN + 1];
+
+    if(request->text!=NULL && request->slot.sequence==0) {
+        snprintf(path, sizeof(path), "/%s", request->rid);
+        shm_unlink(path);
+    }
+    if(request->text!=NULL) {
+        cJSON_free(request->text);
+        request->text = NULL;
+    }
+}
+
+static bool emu_rid_write(const EmuRequest *request) {
+    char path[UUIDBUFLEN + 1];
+    char *map;
+
+    snprintf(path, sizeof(path), "/%s", request->rid);
+    if( (map = (char*)emu_shm_map(path, request->length, true))==NULL ) {
+        return false;
+    }
+    memcpy(map, request->text, request->length);
+    munmap(map, request->length);
+    return true;
+}
+
+//lane lock held, it guards the ring header, a payload the ring can not take goes to the /<rid> segment like gonggo does
+static bool emu_payload_write(EmuLane *lane, EmuRequest *request) {
+    memset(&request->slot, 0, sizeof(ProxyRingSlot));
+    if(lane->ring!=NULL && payload_ring_reserve(lane->ring, request->length - 1, &request->slot)) {
+        memcpy(payload_ring_slot_data(lane->ring, &request->slot), request->text, request->length - 1);
+        return true;
+    }
+    return emu_rid_write(request);
+}
+
+//open loop, each request is due at its own time whether the previous one is answered or not
+static void *emu_lane_worker(void *arg) {
+    EmuLane *lane;
+    EmuRequest requests[CHANNEL_BATCH_MAX];
+    const EmuMix *mix;
+    struct timespec ts;
+    unsigned int count, seed;
+    uint64_t due, interval;
+
+    lane = (EmuLane*)arg;
+    seed = (unsigned int)(uintptr_t)lane ^ (unsigned int)emu_now();
+    interval = lane->rate>0 ? (uint64_t)(1e9 / lane->rate) : 0;
+    count = 0;
+    due = emu_now();
+    while(emu_sending && !emu_stop && !emu_interrupted) {
+        if(interval>0) {
+            due += interval;
+            ts.tv_sec = due / 1000000000ULL;
+            ts.tv_nsec = due % 1000000000ULL;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        } else {
+            due = emu_now();
+        }
+        if( (mix = emu_choose(lane, &seed))==NULL || !emu_request_build(&requests[count], mix, due) ) {
+            continue;
+        }
+        if(mix->kind==EMU_REST) {
+            emu_rest_exchange(lane, &requests[count]);
+            emu_request_clear(&requests[count]);
+        } else if(++count>=emu_batch) {
+            emu_channel_exchange(lane, requests, count);
+            count = 0;
+        }
+    }
+    if(count>0) {
+        emu_channel_exchange(lane, requests, count);
+    }
+    return NULL;
+}
+
+//lane lock is held on return true
+static bool emu_lane_waitfor_idle(EmuLane *lane) {
+    struct timespec ts;
+
+    if(!emu_lock_robust(&lane->shm->lock)) {
+        return false;
+    }
+    while(!emu_stop && lane->shm->state!=CHANNEL_IDLE) {
+        ts = emu_deadline(EMU_WAIT_NS);
+        if(wakeup_timedwait(&lane->idle, &ts)==EOWNERDEAD) {
+            pthread_mutex_consistent(&lane->shm->lock);
+            emu_stop = true;
+        }
+    }
+    if(emu_stop) {
+        pthread_mutex_unlock(&lane->shm->lock);
+        return false;
+    }
+    return true;
+}
+
+static void emu_channel_exchange(EmuLane *lane, EmuRequest *requests, unsigned int count) {
+    ProxyRequestRecord *record;
+    EmuPending *pending;
+    struct timespec ts;
+    unsigned int i, writable;
+    bool acknowledged;
+
+    for(i=0; i<count; i++) {
+        requests[i].failed = true;
+    }
+    acknowledged = false;
+    if(emu_lane_waitfor_idle(lane)) {
+        writable = 0;
+        for(i=0; i<count; i++) {
+            requests[i].failed = !emu_payload_write(lane, &requests[i]);
+            writable += requests[i].failed ? 0 : 1;
+        }
+        pthread_mutex_lock(&emu_lock);
+        for(i=0; i<count; i++) {
+            if(!requests[i].failed && requests[i].kind!=EMU_DROP) {
+                pending = (EmuPending*)malloc(sizeof(EmuPending));
+                pending->kind = requests[i].kind;
+                pending->sent = requests[i].due;
+                pending->answered = false;
+                g_hash_table_insert(emu_pending, strdup(requests[i].rid), pending);//before the proxy can answer
+            }
+        }
+        pthread_mutex_unlock(&emu_lock);
+
+        if(writable>0) {//otherwise the lane stays idle and every request fails
+            memset(&lane->shm->payload_slot, 0, sizeof(ProxyRingSlot));
+            if(emu_batch>1) {
+                for(i=0; i<count; i++) {
+                    record = &lane->shm->requests[i];
+                    memcpy(record->rid, requests[i].rid, UUIDBUFLEN);
+                    record->payload_buff_length = requests[i].failed ? 0 : requests[i].length;
+                    record->payload_slot = requests[i].slot;
+                    record->failed = false;
+                }
+                lane->shm->request_count = count;
+                lane->shm->state = CHANNEL_REQUEST_BATCH;
+            } else {
+                memcpy(lane->shm->rid, requests[0].rid, UUIDBUFLEN);
+                lane->shm->payload_buff_length = requests[0].length;
+                lane->shm->payload_slot = requests[0].slot;
+                lane->shm->state = CHANNEL_REQUEST;
+            }
+            wakeup_signal(&lane->proxy_wakeup);
+        }
+        while(!emu_stop && (lane->shm->state==CHANNEL_REQUEST || lane->shm->state==CHANNEL_REQUEST_BATCH)) {
+            ts = emu_deadline(EMU_WAIT_NS);
+            if(wakeup_timedwait(&lane->dispatcher_wakeup, &ts)==EOWNERDEAD) {
+                pthread_mutex_consistent(&lane->shm->lock);
+                emu_stop = true;
+            }
+        }
+        acknowledged = lane->shm->state==CHANNEL_ACKNOWLEDGED;
+        for(i=0; i<count; i++) {
+            requests[i].failed = requests[i].failed || !acknowledged || (emu_batch>1 && lane->shm->requests[i].failed);
+        }
+        if(acknowledged || lane->shm->state==CHANNEL_FAILS) {//the proxy waits for the verdict either way
+            lane->shm->state = CHANNEL_DONE;
+            wakeup_signal(&lane->proxy_wakeup);
+        }
+        pthread_mutex_unlock(&lane->shm->lock);
+    }
+
+    pthread_mutex_lock(&emu_lock);
+    for(i=0; i<count; i++) {
+        emu_stats[requests[i].kind].sent++;
+        if(!acknowledged || requests[i].failed) {
+            emu_stats[requests[i].kind].failed++;
+            g_hash_table_remove(emu_pending, requests[i].rid);
+        } else if(requests[i].kind==EMU_MULTIRESPOND) {
+            g_ptr_array_add(emu_subscriptions, strdup(requests[i].rid));
+        } else if(requests[i].kind==EMU_DROP) {
+            g_hash_table_remove(emu_pending, requests[i].subscription);//gonggo forgets the dropped client
+        }
+        if(requests[i].kind==EMU_UNSUBSCRIBE && !requests[i].failed) {
+            g_hash_table_remove(emu_pending, requests[i].subscription);
+        }
+    }
+    pthread_mutex_unlock(&emu_lock);
+
+    for(i=0; i<count; i++) {
+        emu_request_clear(&requests[i]);
+    }
+}
+
+static void emu_rest_exchange(EmuLane *lane, EmuRequest *request) {
+    char path[UUIDBUFLEN + 1];
+    const char *answer;
+    char *map;
+    struct timespec ts;
+    size_t length;
+    bool answered;
+
+    pthread_mutex_lock(&emu_lock);
+    emu_stats[EMU_REST].sent++;
+    pthread_mutex_unlock(&emu_lock);
+
+    answered = false;
+    if(emu_lane_waitfor_idle(lane)) {
+        if(emu_payload_write(lane, request)) {//otherwise the lane stays idle and the request fails
+            memcpy(lane->shm->rid, request->rid, UUIDBUFLEN);
+            lane->shm->payload_buff_length = request->length;
+            lane->shm->payload_slot = request->slot;
+            lane->shm->state = CHANNEL_REST;
+            wakeup_signal(&lane->proxy_wakeup);
+        }
+        while(!emu_stop && lane->shm->state==CHANNEL_REST) {
+            ts = emu_deadline(EMU_WAIT_NS);
+            if(wakeup_timedwait(&lane->dispatcher_wakeup, &ts)==EOWNERDEAD) {
+                pthread_mutex_consistent(&lane->shm->lock);
+                emu_stop = true;
+            }
+        }
+        if(lane->shm->state==CHANNEL_REST_RESPOND) {
+            //the answer is read in place, its content is the proxy REST handler business
+            if(lane->shm->answer_slot.sequence!=0 && lane->ring!=NULL) {
+                answer = (const char*)(lane->ring + 1) + lane->shm->answer_slot.offset;
+                answered = answer[0]=='{';
+            } else {
+                snprintf(path, sizeof(path), "/%s", lane->shm->aid);
+                length = lane->shm->answer_buff_length;
+                if( (map = (char*)emu_shm_map(path, length, false))!=NULL ) {
+                    answered = map[0]=='{';
+                    munmap(map, length);
+                }
+            }
+            lane->shm->state = CHANNEL_DONE;
+            wakeup_signal(&lane->proxy_wakeup);
+        }
+        pthread_mutex_unlock(&lane->shm->lock);
+    }
+
+    pthread_mutex_lock(&emu_lock);
+    if(answered) {
+        emu_stats[EMU_REST].answered++;
+        emu_sample(&emu_stats[EMU_REST], emu_now() - request->due);
+    } else {
+        emu_stats[EMU_REST].failed++;
+    }
+    pthread_mutex_unlock(&emu_lock);
+}
+
+//the answer handshake, proxysubscribe locks only while it hands an answer over
+static void *emu_subscribe_worker(void *arg) {
+    const ProxyAnswerRecord *record;
+    const char *answer;
+    char path[UUIDBUFLEN + 1];
+    char *map;
+    struct timespec ts;
+    size_t length, offset;
+    unsigned int i;
+    uint64_t now;
+
+    if(!emu_lock_robust(&emu_subscribe->lock)) {
+        return NULL;
+    }
+    while(!emu_stop) {
+        ts = emu_deadline(EMU_WAIT_NS);
+        if(emu_subscribe->state!=SUBSCRIBE_ANSWER
+            && wakeup_timedwait(&emu_subscribe_dispatcher_wakeup, &ts)==EOWNERDEAD)
+        {
+            pthread_mutex_consistent(&emu_subscribe->lock);
+            emu_stop = true;
+            break;
+        }
+        if(emu_subscribe->state!=SUBSCRIBE_ANSWER) {
+            continue;
+        }
+
+        now = emu_now();
+        map = NULL;
+        length = emu_subscribe->payload_buff_length;
+        if(emu_subscribe->answer_slot.sequence!=0 && emu_subscribe_ring!=NULL) {
+            answer = (const char*)(emu_subscribe_ring + 1) + emu_subscribe->answer_slot.offset;
+        } else {
+            snprintf(path, sizeof(path), "/%s", emu_subscribe->aid);
+            map = (char*)emu_shm_map(path, length, false);
+            answer = map;
+        }
+        if(answer!=NULL && emu_subscribe->answer_count<1) {
+            emu_answer_parse(answer, length, now);
+        } else if(answer!=NULL) {
+            offset = 0;
+            for(i=0; i<emu_subscribe->answer_count && offset + sizeof(ProxyAnswerRecord)<=length; i++) {
+                record = (const ProxyAnswerRecord*)(answer + offset);
+                emu_answer_parse((const char*)(record + 1), record->length, now);
+                offset += (sizeof(ProxyAnswerRecord) + record->length + ANSWER_RECORD_ALIGN - 1) & ~((size_t)ANSWER_RECORD_ALIGN - 1);
+            }
+        }
+        if(map!=NULL) {
+            munmap(map, length);
+        }
+
+        emu_subscribe->state = SUBSCRIBE_DONE;
+        wakeup_signal(&emu_subscribe_proxy_wakeup);
+    }
+    pthread_mutex_unlock(&emu_subscribe->lock);
+    return NULL;
+}
+
+static void emu_answer_parse(const char *text, size_t length, uint64_t now) {
+    cJSON *json, *rid, *item;
+
+    json = cJSON_ParseWithLength(text, length);
+    rid = json!=NULL ? cJSON_GetObjectItem(json, SERVICE_RID_KEY) : NULL;
+    pthread_mutex_lock(&emu_lock);
+    if(cJSON_IsString(rid)) {
+        emu_answer_rid(cJSON_GetStringValue(rid), now);
+    } else if(cJSON_IsArray(rid)) {
+        cJSON_ArrayForEach(item, rid) {
+            emu_answer_rid(cJSON_GetStringValue(item), now);
+        }
+    } else {
+        emu_unmatched++;
+    }
+    pthread_mutex_unlock(&emu_lock);
+    cJSON_Delete(json);
+}
+
+//emu_lock is held
+static void emu_answer_rid(const char *rid, uint64_t now) {
+    EmuPending *pending;
+    EmuStats *stats;
+
+    if(rid==NULL || (pending = (EmuPending*)g_hash_table_lookup(emu_pending, rid))==NULL) {
+        emu_unmatched++;
+        return;
+    }
+    stats = &emu_stats[pending->kind];
+    if(pending->answered) {
+        stats->stream++;
+        return;
+    }
+    pending->answered = true;
+    stats->answered++;
+    emu_sample(stats, now>pending->sent ? now - pending->sent : 0);
+    if(pending->kind!=EMU_MULTIRESPOND) {
+        g_hash_table_remove(emu_pending, rid);
+    }
+}
+
+static void emu_sample(EmuStats *stats, uint64_t ns) {
+    if(stats->sample_count>=stats->sample_capacity) {
+        stats->sample_capacity = stats->sample_capacity>0 ? stats->sample_capacity * 2 : 4096;
+        stats->samples = (uint64_t*)realloc(stats->samples, stats->sample_capacity * sizeof(uint64_t));
+    }
+    stats->samples[stats->sample_count++] = ns;
+}
+
+static int emu_compare(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+
+    return x<y ? -1 : (x>y ? 1 : 0);
+}
+
+//nearest rank on sorted samples, us
+static double emu_percentile(const EmuStats *stats, double p) {
+    size_t rank;
+
+    if(stats->sample_count<1) {
+        return 0;
+    }
+    rank = (size_t)(p * stats->sample_count);
+    if(rank>=stats->sample_count) {
+        rank = stats->sample_count - 1;
+    }
+    return stats->samples[rank] / 1000.0;
+}
+
+static void emu_report(double seconds) {
+    GHashTableIter iter;
+    gpointer value;
+    uint64_t pending[EMU_KIND_COUNT] = {0}, answered, answers;
+    EmuStats *stats;
+    unsigned int k;
+
+    pthread_mutex_lock(&emu_lock);
+    g_hash_table_iter_init(&iter, emu_pending);
+    while(g_hash_table_iter_next(&iter, NULL, &value)) {
+        if(!((EmuPending*)value)->answered) {
+            pending[((EmuPending*)value)->kind]++;
+        }
+    }
+
+    printf("proxy %s, %.1f s at a target of %.0f requests/s, batch %u\n", emu_proxy, seconds, emu_rate, emu_batch);
+    printf("%-13s %10s %8s %10s %8s %10s %10s %10s %10s %10s\n",
+        "kind", "sent", "failed", "answered", "pending", "stream", "p50_us", "p99_us", "p999_us", "max_us");
+    answered = answers = 0;
+    for(k=0; k<EMU_KIND_COUNT; k++) {
+        stats = &emu_stats[k];
+        if(stats->sent<1 && stats->failed<1) {
+            continue;
+        }
+        qsort(stats->samples, stats->sample_count, sizeof(uint64_t), emu_compare);
+        printf("%-13s %10lu %8lu %10lu %8lu %10lu %10.1f %10.1f %10.1f %10.1f\n", emu_kind_names[k],
+            (unsigned long)stats->sent, (unsigned long)stats->failed, (unsigned long)stats->answered, (unsigned long)pending[k],
+            (unsigned long)stats->stream, emu_percentile(stats, 0.5), emu_percentile(stats, 0.99), emu_percentile(stats, 0.999),
+            stats->sample_count>0 ? stats->samples[stats->sample_count - 1] / 1000.0 : 0.0);
+        answered += stats->answered;
+        answers += stats->answered + stats->stream;
+    }
+    printf("throughput %.1f requests/s answered, %.1f answers/s, %lu unmatched answers\n",
+        seconds>0 ? answered / seconds : 0.0, seconds>0 ? answers / seconds : 0.0, (unsigned long)emu_unmatched);
+    pthread_mutex_unlock(&emu_lock);
+
+}
\ No newline at end of file
@@ -0,0 +1,112 @@
+//dump the /<proxy>_metrics segment of a running sawang proxy
+//usage: sawangmetrics <proxy name> [interval seconds]
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "metrics.h"
+
+static const char *counter_names[] = METRICS_COUNTER_NAMES;
+static const char *histogram_names[] = METRICS_HISTOGRAM_NAMES;
+
+static void dump(const MetricsShm *shm);
+static double percentile(const MetricsHistogramShm *h, uint64_t count, double p);
+
+int main(int argc, char **argv) {
+    char *path;
+    const MetricsShm *shm;
+    unsigned int interval;
+    int fd;
+
+    if(argc<2) {
+        fprintf(stderr, "usage: %s <proxy name> [interval seconds]\n", argv[0]);
+        return 1;
+    }
+    interval = argc>2 ? (unsigned int)atoi(argv[2]) : 0;
+
+    path = (char*)malloc(strlen(argv[1]) + strlen(METRICS_SUFFIX) + 2);
+    sprintf(path, "/%s%s", argv[1], METRICS_SUFFIX);
+    fd = shm_open(path, O_RDONLY, 0);
+    if(fd==-1) {
+        fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+        free(path);
+        return 1;
+    }
+    shm = (const MetricsShm*)mmap(NULL, sizeof(MetricsShm), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(shm==MAP_FAILED) {
+        fprintf(stderr, "cannot map %s: %s\n", path, strerror(errno));
+        free(path);
+        return 1;
+    }
+    if(shm->magic!=METRICS_MAGIC || shm->version!=METRICS_VERSION) {
+        fprintf(stderr, "%s is not a version %d metrics segment\n", path, METRICS_VERSION);
+        munmap((void*)shm, sizeof(MetricsShm));
+        free(path);
+        return 1;
+    }
+
+    do {
+        dump(shm);
+        if(interval>0) {
+            sleep(interval);
+            printf("\n");
+        }
+    } while(interval>0);
+
+    munmap((void*)shm, sizeof(MetricsShm));
+    free(path);
+    return 0;
+}
+
+static void dump(const MetricsShm *shm) {
+    const MetricsHistogramShm *h;
+    int64_t counters[METRICS_COUNTER_COUNT];
+    uint64_t count, sum;
+    unsigned int i;
+
+    for(i=0; i<METRICS_COUNTER_COUNT; i++) {
+        counters[i] = atomic_load_explicit(&shm->counters[i], memory_order_relaxed);
+    }
+
+    printf("pid %d up %lds\n", (int)shm->pid, (long)(time(NULL) - shm->started));
+    for(i=0; i<METRICS_COUNTER_COUNT; i++) {
+        printf("%-32s %lld\n", counter_names[i], (long long)counters[i]);
+    }
+    printf("%-32s %lld\n", "parse_queue_depth", (long long)(counters[METRICS_PARSE_QUEUE_PUSHED] - counters[METRICS_PARSE_QUEUE_POPPED]));
+    printf("%-32s %lld\n", "reply_queue_depth", (long long)(counters[METRICS_REPLY_QUEUE_PUSHED] - counters[METRICS_REPLY_QUEUE_POPPED]));
+
+    printf("%-24s %12s %12s %12s %12s\n", "histogram", "count", "mean_us", "p50_us", "p99_us");
+    for(i=0; i<METRICS_HISTOGRAM_COUNT; i++) {
+        h = &shm->histograms[i];
+        count = atomic_load_explicit(&h->count, memory_order_relaxed);
+        sum = atomic_load_explicit(&h->sum_ns, memory_order_relaxed);
+        printf("%-24s %12llu %12.1f %12.0f %12.0f\n", histogram_names[i], (unsigned long long)count, 
+            count>0 ? (double)sum / count / 1000.0 : 0.0, percentile(h, count, 0.50), percentile(h, count, 0.99));
+    }
+}
+
+//upper bound of the bucket holding the percentile
+static double percentile(const MetricsHistogramShm *h, uint64_t count, double p) {
+    uint64_t seen, target;
+    unsigned int i;
+
+    if(count<1) {
+        return 0.0;
+    }
+    target = (uint64_t)(count * p);
+    seen = 0;
+    for(i=0; i<METRICS_BUCKETS; i++) {
+        seen += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+        if(seen>target) {
+            return (double)(1ULL << i);
+        }
+    }
+    return (double)(1ULL << (METRICS_BUCKETS - 1));
+}
\ No newline at end of file